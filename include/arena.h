@@ -0,0 +1,28 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// huge page size on x86-64 and arm64
+#define ARENA_ALIGN (2 * 1024 * 1024)
+
+// one mapping carved up by a bump pointer; pages come from the kernel
+// zeroed and are only backed once touched, so nothing needs clearing
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+} Arena;
+
+bool arena_init(Arena *arena, size_t size);
+void arena_release(Arena *arena);
+
+// zeroed; NULL when the arena is too small
+void *arena_push(Arena *arena, size_t size, size_t align);
+
+// hands every page back and makes the whole arena read as zero again,
+// keeping the carved layout
+void arena_zero(Arena *arena);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CLUSTER_H_
+#define CLUSTER_H_
+
+#include "command.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// ghost rows each worker mirrors from a neighbouring slab
+#define CLUSTER_HALO 8
+#define CLUSTER_MIN_SLAB 32
+
+// the world is split into horizontal slabs, one worker process per slab;
+// the coordinator only forwards edits and gathers downsampled frames.
+// Results look like a single process's but are not step-for-step equal
+typedef struct {
+    int procs;
+    int width;
+    int height;
+    int scale;
+    int *slab_y;
+    int *pids;
+    int *control;
+} Cluster;
+
+bool cluster_start(Cluster *cluster, int procs, int width, int height, int scale);
+void cluster_stop(Cluster *cluster);
+
+bool cluster_step(Cluster *cluster, int ticks);
+// command coordinates are in world cells
+bool cluster_edit(Cluster *cluster, const Command *command);
+
+// fills (width / scale) x (height / scale) pixels, same format as the game texture
+bool cluster_read_frame(Cluster *cluster, uint32_t *pixels, int row_pixels);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef COLOR_H_
 #define COLOR_H_
 
+#include <stdint.h>
+
 typedef struct {
     unsigned char r;
     unsigned char g;
@@ -10,6 +12,17 @@ typedef struct {
 
 #define COLOR_SAND (Color){ 236, 204, 160, 220 }
 #define COLOR_WATER (Color){ 66, 135, 245, 180 }
+#define COLOR_STEAM (Color){ 210, 220, 230, 120 }
+#define COLOR_GLASS (Color){ 170, 215, 210, 200 }
+#define COLOR_SMOKE (Color){ 90, 90, 95, 150 }
 #define COLOR_AIR (Color){ 0, 0, 0, 0 }
 
+// one ABGR8888 pixel, the format of the game texture
+static inline uint32_t color_pack(Color c) {
+    return ((uint32_t)c.a << 24) |
+           ((uint32_t)c.b << 16) |
+           ((uint32_t)c.g << 8) |
+           ((uint32_t)c.r);
+}
+
 #endif
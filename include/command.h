@@ -0,0 +1,50 @@
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include "particle.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// must be a power of two
+#define COMMAND_QUEUE_CAPACITY 1024
+
+typedef enum {
+    COMMAND_PAINT,
+    COMMAND_ERASE,
+    COMMAND_HEAT,
+    COMMAND_LINE,
+    COMMAND_CLEAR,
+    COMMAND_RESET
+} CommandKind;
+
+// a world edit in simulation coordinates; a line runs from (x, y) to
+// (x2, y2) and erases when type is PARTICLE_NONE
+typedef struct {
+    CommandKind kind;
+    int x;
+    int y;
+    int x2;
+    int y2;
+    int radius;
+    ParticleType type;
+    float amount;
+} Command;
+
+// lock-free ring for exactly one producer thread and one consumer thread;
+// each index is only written by its own side
+typedef struct {
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    Command slots[COMMAND_QUEUE_CAPACITY];
+} CommandQueue;
+
+void command_queue_init(CommandQueue *queue);
+
+// producer side; fails without blocking when the ring is full
+bool command_queue_push(CommandQueue *queue, const Command *command);
+
+// consumer side; fails when the ring is empty
+bool command_queue_pop(CommandQueue *queue, Command *out);
+
+#endif
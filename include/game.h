@@ -2,9 +2,14 @@
 #define GAME_H_
 
 #include <SDL3/SDL.h>
+#include "cluster.h"
+#include "history.h"
 #include "particle.h"
 #include "simulation.h"
 
+#define SPEED_MAX 0
+#define SPEED_LIMIT 1024
+
 typedef struct {
     SDL_Window* window;
     SDL_Renderer* renderer;
@@ -15,10 +20,38 @@ typedef struct {
 
     Simulation sim;
 
+    // multi-process mode, the world is world_scale times the texture size
+    int procs;
+    int world_scale;
+    Cluster cluster;
+
+    // ticks per rendered frame, SPEED_MAX runs as many as the frame budget allows
+    int speed;
+    int frame_ticks;
+    int tick_count;
+    int ticks_per_second;
+    int tick_cap;
+
+    // run the frame's last tick straight into the locked texture
+    bool fused;
+
+    // rewind buffer, not available in multi-process mode
+    History history;
+    int history_mb;
+    bool paused;
+    Uint64 tps_time;
+
     int mouse_x;
     int mouse_y;
     bool mouse_left;
     bool mouse_right;
+    bool mouse_middle;
+
+    // previous brush position while a stroke is held, in sim cells
+    bool stroking;
+    int stroke_x;
+    int stroke_y;
+
     int brush_size;
     ParticleType current_type;
 } Game;
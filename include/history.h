@@ -0,0 +1,77 @@
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include "simulation.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTORY_KEYFRAME_INTERVAL 60
+#define HISTORY_MAX_RECORDS 65536
+
+// velocities are kept in steps of 1 / HISTORY_VELOCITY_SCALE so that the
+// slow decay of resting particles does not show up as a change every tick
+#define HISTORY_VELOCITY_SCALE 8.0f
+
+typedef union {
+    struct {
+        uint32_t color;
+        uint8_t type;
+        int8_t vx;
+        int8_t vy;
+        uint8_t unused;
+    };
+    uint64_t bits;
+} HistoryCell;
+
+// every record holds the changed cells XORed against the previous tick, so
+// the same delta steps forwards or backwards; keyframes also hold a
+// run-length encoded copy of the whole grid and the heat field
+typedef struct {
+    int tick;
+    unsigned int rng_state;
+    bool keyframe;
+    size_t offset;
+    size_t delta_size;
+    size_t size;
+} HistoryRecord;
+
+typedef struct {
+    int width;
+    int height;
+    int heat_cells;
+
+    // sim->generation the shadow was built from; a reset starts over
+    int generation;
+
+    uint8_t *ring;
+    size_t ring_size;
+
+    HistoryRecord *records;
+    int first;
+    int count;
+    int cursor;
+
+    HistoryCell *shadow;
+    uint8_t *scratch;
+    int *dirty;
+    int dirty_count;
+    uint8_t *dirty_mark;
+} History;
+
+// enables change tracking on sim, recording reads only the touched cells.
+// budget covers all memory the history uses, about 42 bytes per cell plus
+// 2.5 MB of record table, and the ring gets what is left; fails when
+// that is less than one worst-case keyframe
+bool history_init(History *history, Simulation *sim, size_t budget);
+void history_cleanup(History *history);
+
+// call once per tick after sim_update; scrubbing back and recording again
+// discards the ticks after the cursor, and a sim_reset discards everything
+bool history_record(History *history, Simulation *sim);
+bool history_seek(History *history, Simulation *sim, int tick);
+
+int history_first_tick(const History *history);
+int history_last_tick(const History *history);
+
+#endif
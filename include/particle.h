@@ -15,6 +15,9 @@ typedef enum {
     PARTICLE_NONE = 0,
     PARTICLE_SAND,
     PARTICLE_WATER,
+    PARTICLE_STEAM,
+    PARTICLE_GLASS,
+    PARTICLE_SMOKE,
     PARTICLE_COUNT
 } ParticleType;
 
@@ -23,6 +26,12 @@ typedef struct {
     ParticleState state;
     float density;
     float viscosity;
+
+    // heat-driven state changes; PARTICLE_NONE means no transition
+    float hot_point;
+    ParticleType hot_type;
+    float cold_point;
+    ParticleType cold_type;
 } ParticleProperties;
 
 typedef struct {
@@ -1,27 +1,158 @@
 #ifndef SIMULATION_H_
 #define SIMULATION_H_
 
+#include "arena.h"
+#include "command.h"
 #include "particle.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #define GRAVITY 0.5f;
 
+// furthest a single particle update reaches above or below its own row
+#define SIM_ROW_REACH 8
+
+// with SIM_TILED the grid is stored as SIM_TILE_WIDTH x SIM_TILE_HEIGHT
+// tiles, so the cells below a particle sit a row segment away instead of
+// a full row stride; tiles are wide because sweeps still run along rows
+// and need long contiguous segments for the prefetcher
+#ifdef SIM_TILED
+#ifndef SIM_TILE_WIDTH_SHIFT
+#define SIM_TILE_WIDTH_SHIFT 7
+#endif
+#ifndef SIM_TILE_HEIGHT_SHIFT
+#define SIM_TILE_HEIGHT_SHIFT 3
+#endif
+#define SIM_TILE_WIDTH (1 << SIM_TILE_WIDTH_SHIFT)
+#define SIM_TILE_HEIGHT (1 << SIM_TILE_HEIGHT_SHIFT)
+#endif
+
+// damped sideways velocity below this snaps to zero instead of decaying
+// through denormals, so particles at rest stop changing
+#define VELOCITY_REST (1.0f / 64.0f)
+
+// temperature is stored as heat above ambient, one value per
+// HEAT_CELL_SIZE x HEAT_CELL_SIZE block of particle cells
+#define HEAT_CELL_SHIFT 2
+#define HEAT_CELL_SIZE (1 << HEAT_CELL_SHIFT)
+#define HEAT_DIFFUSION 0.2f
+#define HEAT_RETENTION 0.995f
+#define HEAT_MAX 1000.0f
+#define HEAT_BAND_ROWS 16
+// smaller fields diffuse in a few microseconds, about what waking an
+// OpenMP team costs, so they stay on one thread
+#define HEAT_PARALLEL_CELLS 65536
+
 typedef struct {
     int width;
     int height;
+    int tiles_x;
     Particle **grid;
+
+    // slots below pool_used have been handed out at least once; freed ones
+    // go on the free list, the rest are taken in order
     Particle *pool;
+    int pool_used;
     int *free_list;
     int free_count;
     unsigned int rng_state;
     int current_tick;
+
+    // rows sweeps may read and write, normally all of them
+    int rows_begin;
+    int rows_end;
+
+    // rows that a later sim_update_rows of this tick will still sweep; a
+    // powder or liquid resting on an unmoved particle in them is skipped
+    // rather than settled. Empty unless the caller splits the sweep
+    int defer_begin;
+    int defer_end;
+
+    // one bit per cell, set while it holds a particle that can change on
+    // its own, so sweeps skip empty cells and inert solids 64 at a time
+    // and such rows entirely
+    uint64_t *active;
+    int active_words;
+    int *row_active;
+
+    // padded by one cell on each side so the stencil needs no edge cases
+    int heat_width;
+    int heat_height;
+    int heat_stride;
+    float *heat;
+    float *heat_back;
+
+    // row-major indices of cells touched since the last sim_reset_changes,
+    // only kept after sim_track_changes
+    int *changed;
+    unsigned char *changed_mark;
+    int changed_count;
+
+    // world edits from any one producer, applied at the start of each tick
+    CommandQueue commands;
+
+    // every array above lives in this one mapping
+    Arena arena;
+
+    // bumped by sim_reset so observers can tell their copies are stale
+    int generation;
 } Simulation;
 
-bool sim_init(Simulation *sim);
+static inline int sim_grid_index(const Simulation *sim, int x, int y) {
+#ifdef SIM_TILED
+    int tile = (y >> SIM_TILE_HEIGHT_SHIFT) * sim->tiles_x + (x >> SIM_TILE_WIDTH_SHIFT);
+    return (tile << (SIM_TILE_WIDTH_SHIFT + SIM_TILE_HEIGHT_SHIFT)) +
+           ((y & (SIM_TILE_HEIGHT - 1)) << SIM_TILE_WIDTH_SHIFT) +
+           (x & (SIM_TILE_WIDTH - 1));
+#else
+    return y * sim->width + x;
+#endif
+}
+
+// number of cells from column x onwards that are contiguous in grid
+static inline int sim_grid_run(const Simulation *sim, int x) {
+#ifdef SIM_TILED
+    int run = SIM_TILE_WIDTH - (x & (SIM_TILE_WIDTH - 1));
+    return run < sim->width - x ? run : sim->width - x;
+#else
+    return sim->width - x;
+#endif
+}
+
+bool sim_init(Simulation *sim, int width, int height);
 void sim_cleanup(Simulation *sim);
 void sim_update(Simulation *sim);
 void sim_brush_cirlce(Simulation *sim, int cx, int cy, int radius, ParticleType type);
 void sim_brush_erase(Simulation *sim, int cx, int cy, int radius);
+void sim_brush_heat(Simulation *sim, int cx, int cy, int radius, float amount);
+void sim_brush_line(Simulation *sim, int x0, int y0, int x1, int y1, int radius, ParticleType type);
+bool sim_spawn_particles(Simulation *sim, int x, int y, ParticleType type);
 void sim_remove_particle(Simulation *sim, int x, int y);
+void sim_clear(Simulation *sim);
+
+// empties the world, particles and heat, without freeing or re-touching
+// any memory
+void sim_reset(Simulation *sim);
+
+// sim_update is sim_begin_tick followed by sim_update_rows over the whole
+// grid; partial row ranges let a caller interleave other work in a tick.
+// sim_begin_tick applies queued commands before anything else
+void sim_begin_tick(Simulation *sim);
+void sim_update_rows(Simulation *sim, int y_begin, int y_end);
+
+// runs one tick and reports each row as soon as it can no longer change,
+// bottom row first
+typedef void (*SimRowCallback)(Simulation *sim, int y, void *user);
+void sim_update_fused(Simulation *sim, SimRowCallback row_done, void *user);
+
+// cells are copied by value; an empty cell reads back as PARTICLE_NONE
+void sim_read_cell(Simulation *sim, int x, int y, Particle *out);
+void sim_write_cell(Simulation *sim, int x, int y, const Particle *src);
+
+void sim_apply_command(Simulation *sim, const Command *command);
+void sim_apply_commands(Simulation *sim);
+
+bool sim_track_changes(Simulation *sim);
+void sim_reset_changes(Simulation *sim);
 
 #endif
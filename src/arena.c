@@ -0,0 +1,62 @@
+#define _DEFAULT_SOURCE
+
+#include "arena.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static inline size_t align_up(size_t value, size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+bool arena_init(Arena *arena, size_t size) {
+    *arena = (Arena){ 0 };
+    size = align_up(size, ARENA_ALIGN);
+
+    // map one extra huge page so the start can be moved up to a boundary
+    size_t mapped = size + ARENA_ALIGN;
+    unsigned char *raw = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return false;
+
+    unsigned char *base = (unsigned char *)align_up((uintptr_t)raw, ARENA_ALIGN);
+    size_t head = (size_t)(base - raw);
+
+    if (head > 0)
+        munmap(raw, head);
+    munmap(base + size, mapped - head - size);
+
+#ifdef MADV_HUGEPAGE
+    madvise(base, size, MADV_HUGEPAGE);
+#endif
+
+    arena->base = base;
+    arena->size = size;
+    return true;
+}
+
+void arena_release(Arena *arena) {
+    if (arena->base)
+        munmap(arena->base, arena->size);
+
+    *arena = (Arena){ 0 };
+}
+
+void *arena_push(Arena *arena, size_t size, size_t align) {
+    size_t offset = align_up(arena->used, align);
+    if (offset + size > arena->size)
+        return NULL;
+
+    arena->used = offset + size;
+    return arena->base + offset;
+}
+
+void arena_zero(Arena *arena) {
+#ifdef __linux__
+    // private anonymous pages read back as zero after MADV_DONTNEED
+    if (madvise(arena->base, arena->size, MADV_DONTNEED) == 0)
+        return;
+#endif
+    memset(arena->base, 0, arena->used);
+}
@@ -0,0 +1,477 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cluster.h"
+#include "simulation.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef enum {
+    MSG_STEP,
+    MSG_EDIT,
+    MSG_FRAME,
+    MSG_QUIT
+} MessageKind;
+
+typedef struct {
+    int kind;
+    int value;
+    Command command;
+} Message;
+
+typedef struct {
+    Simulation sim;
+    int index;
+    int scale;
+    int global_y;
+    int own_begin;
+    int own_mid;
+    int own_end;
+    int up;
+    int down;
+    int control;
+    Particle *rows;
+    uint32_t *frame;
+} Worker;
+
+static bool write_all(int fd, const void *buf, size_t size) {
+    const char *data = (const char *)buf;
+
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+
+    return true;
+}
+
+static bool read_all(int fd, void *buf, size_t size) {
+    char *data = (char *)buf;
+
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (n == 0)
+            return false;
+        data += n;
+        size -= (size_t)n;
+    }
+
+    return true;
+}
+
+static void close_fd(int fd) {
+    if (fd >= 0)
+        close(fd);
+}
+
+static inline float *heat_row(Simulation *sim, int hy) {
+    return sim->heat + (hy + 1) * sim->heat_stride + 1;
+}
+
+// rows and their heat cells travel together; y and count are multiples of
+// HEAT_CELL_SIZE because slab boundaries and CLUSTER_HALO are
+static bool send_rows(Worker *w, int fd, int y, int count, bool with_heat) {
+    Simulation *sim = &w->sim;
+
+    for (int row = 0; row < count; row++) {
+        for (int x = 0; x < sim->width; x++) {
+            sim_read_cell(sim, x, y + row, &w->rows[row * sim->width + x]);
+        }
+    }
+
+    if (!write_all(fd, w->rows, (size_t)count * sim->width * sizeof(Particle)))
+        return false;
+
+    if (!with_heat)
+        return true;
+
+    for (int hy = y >> HEAT_CELL_SHIFT; hy < (y + count) >> HEAT_CELL_SHIFT; hy++) {
+        if (!write_all(fd, heat_row(sim, hy), sim->heat_width * sizeof(float)))
+            return false;
+    }
+
+    return true;
+}
+
+static bool recv_rows(Worker *w, int fd, int y, int count, bool with_heat) {
+    Simulation *sim = &w->sim;
+
+    if (!read_all(fd, w->rows, (size_t)count * sim->width * sizeof(Particle)))
+        return false;
+
+    for (int row = 0; row < count; row++) {
+        for (int x = 0; x < sim->width; x++) {
+            sim_write_cell(sim, x, y + row, &w->rows[row * sim->width + x]);
+        }
+    }
+
+    if (!with_heat)
+        return true;
+
+    for (int hy = y >> HEAT_CELL_SHIFT; hy < (y + count) >> HEAT_CELL_SHIFT; hy++) {
+        if (!read_all(fd, heat_row(sim, hy), sim->heat_width * sizeof(float)))
+            return false;
+    }
+
+    return true;
+}
+
+// Each half of the slab borrows the neighbouring slab's edge rows while it
+// is swept and hands them back afterwards, so every cell has exactly one
+// writer. Each send is received by the neighbour in the same phase, just
+// before its sweep, so neighbours run the phases in lockstep and the
+// exchange is not overlapped with computation.
+//
+// Sweeping the upper half first reverses the bottom-to-top order at the
+// midline. Particles there that rest on the unswept lower half are
+// deferred and swept again once their own top rows come back, so a
+// falling column keeps its speed across the seam. Moves still happen in a
+// different order and with a different random stream from sim_update, so
+// a cluster run is not step-for-step equal to a single process.
+static bool worker_tick(Worker *w) {
+    Simulation *sim = &w->sim;
+    int top_ghost = 0;
+    int bottom_ghost = w->own_end;
+
+    sim_begin_tick(sim);
+
+    if (w->down >= 0 && !send_rows(w, w->down, w->own_end - CLUSTER_HALO, CLUSTER_HALO, true))
+        return false;
+    if (w->up >= 0 && !recv_rows(w, w->up, top_ghost, CLUSTER_HALO, true))
+        return false;
+
+    // own rows only: flags in borrowed rows belong to the neighbour's sweep
+    sim->defer_begin = w->own_begin;
+    sim->defer_end = w->own_end;
+    sim_update_rows(sim, w->own_begin, w->own_mid);
+    sim->defer_begin = 0;
+    sim->defer_end = 0;
+
+    if (w->up >= 0) {
+        if (!send_rows(w, w->up, top_ghost, CLUSTER_HALO, false))
+            return false;
+        if (!send_rows(w, w->up, w->own_begin, CLUSTER_HALO, true))
+            return false;
+    }
+    if (w->down >= 0) {
+        if (!recv_rows(w, w->down, w->own_end - CLUSTER_HALO, CLUSTER_HALO, false))
+            return false;
+        if (!recv_rows(w, w->down, bottom_ghost, CLUSTER_HALO, true))
+            return false;
+    }
+
+    sim_update_rows(sim, w->own_mid, w->own_end);
+
+    if (w->down >= 0 && !send_rows(w, w->down, bottom_ghost, CLUSTER_HALO, false))
+        return false;
+    if (w->up >= 0 && !recv_rows(w, w->up, w->own_begin, CLUSTER_HALO, false))
+        return false;
+
+    // only the deferred particles are still waiting; the ghost rows have
+    // been handed back, so they are walls for this sweep
+    sim->rows_begin = w->own_begin;
+    sim->rows_end = w->own_end;
+    sim_update_rows(sim, w->own_begin, w->own_mid);
+    sim->rows_begin = 0;
+    sim->rows_end = sim->height;
+
+    return true;
+}
+
+// brushes may also touch ghost rows; those copies are overwritten by the
+// owning worker's data at the next exchange. Messages only arrive between
+// ticks, so applying straight away matches applying at the next tick start
+static void worker_edit(Worker *w, const Message *msg) {
+    Command command = msg->command;
+    command.y -= w->global_y;
+    command.y2 -= w->global_y;
+
+    sim_apply_command(&w->sim, &command);
+}
+
+static bool worker_send_frame(Worker *w) {
+    Simulation *sim = &w->sim;
+    int scale = w->scale;
+    int out_w = sim->width / scale;
+    int out_h = (w->own_end - w->own_begin) / scale;
+
+    for (int oy = 0; oy < out_h; oy++) {
+        for (int ox = 0; ox < out_w; ox++) {
+            uint32_t pixel = 0x00000000;
+
+            for (int i = 0; i < scale * scale && !pixel; i++) {
+                int x = ox * scale + i % scale;
+                int y = w->own_begin + oy * scale + i / scale;
+                Particle *p = sim->grid[sim_grid_index(sim, x, y)];
+
+                if (p)
+                    pixel = color_pack(p->color);
+            }
+
+            w->frame[oy * out_w + ox] = pixel;
+        }
+    }
+
+    return write_all(w->control, w->frame, (size_t)out_w * out_h * sizeof(uint32_t));
+}
+
+static int worker_run(Worker *w) {
+    Message msg;
+
+    while (read_all(w->control, &msg, sizeof(msg))) {
+        switch (msg.kind) {
+            case MSG_STEP:
+                for (int i = 0; i < msg.value; i++) {
+                    if (!worker_tick(w))
+                        return 1;
+                }
+                break;
+            case MSG_EDIT:
+                worker_edit(w, &msg);
+                break;
+            case MSG_FRAME:
+                if (!worker_send_frame(w))
+                    return 1;
+                break;
+            case MSG_QUIT:
+                return 0;
+        }
+    }
+
+    return 0;
+}
+
+static int worker_main(Cluster *cluster, int index, int up, int down, int control) {
+    Worker w = { 0 };
+    int y0 = cluster->slab_y[index];
+    int y1 = cluster->slab_y[index + 1];
+    int top_ghost = (up >= 0) ? CLUSTER_HALO : 0;
+    int bottom_ghost = (down >= 0) ? CLUSTER_HALO : 0;
+
+    w.index = index;
+    w.scale = cluster->scale;
+    w.global_y = y0 - top_ghost;
+    w.own_begin = top_ghost;
+    w.own_mid = top_ghost + (y1 - y0) / 2;
+    w.own_end = top_ghost + (y1 - y0);
+    w.up = up;
+    w.down = down;
+    w.control = control;
+
+    if (!sim_init(&w.sim, cluster->width, top_ghost + (y1 - y0) + bottom_ghost))
+        return 1;
+
+    w.sim.rng_state ^= (unsigned int)(index + 1) * 2654435761u;
+    if (w.sim.rng_state == 0)
+        w.sim.rng_state = 1;
+
+    w.rows = (Particle *)malloc((size_t)CLUSTER_HALO * cluster->width * sizeof(Particle));
+    w.frame = (uint32_t *)malloc((size_t)(cluster->width / w.scale) * ((y1 - y0) / w.scale) * sizeof(uint32_t));
+
+    int result = 1;
+    if (w.rows && w.frame)
+        result = worker_run(&w);
+
+    free(w.rows);
+    free(w.frame);
+    sim_cleanup(&w.sim);
+    return result;
+}
+
+static bool plan_slabs(Cluster *cluster) {
+    int align = HEAT_CELL_SIZE * cluster->scale;
+    int base = (cluster->height / cluster->procs) / align * align;
+
+    if (cluster->width % cluster->scale || cluster->height % align)
+        return false;
+    if (base < CLUSTER_MIN_SLAB)
+        return false;
+
+    for (int k = 0; k < cluster->procs; k++) {
+        cluster->slab_y[k] = k * base;
+    }
+    cluster->slab_y[cluster->procs] = cluster->height;
+
+    return true;
+}
+
+bool cluster_start(Cluster *cluster, int procs, int width, int height, int scale) {
+    *cluster = (Cluster){ 0 };
+    cluster->width = width;
+    cluster->height = height;
+    cluster->scale = scale;
+    cluster->procs = procs;
+
+    cluster->slab_y = (int *)calloc(procs + 1, sizeof(int));
+    cluster->pids = (int *)calloc(procs, sizeof(int));
+    cluster->control = (int *)calloc(procs, sizeof(int));
+    int *links = (int *)calloc(2 * procs, sizeof(int));
+    int *worker_ends = (int *)calloc(procs, sizeof(int));
+
+    if (!cluster->slab_y || !cluster->pids || !cluster->control || !links || !worker_ends || !plan_slabs(cluster)) {
+        free(links);
+        free(worker_ends);
+        cluster->procs = 0;
+        cluster_stop(cluster);
+        return false;
+    }
+
+    for (int k = 0; k < procs; k++) {
+        cluster->control[k] = -1;
+        worker_ends[k] = -1;
+        links[2 * k] = -1;
+        links[2 * k + 1] = -1;
+    }
+
+    // links[2k] belongs to worker k, links[2k + 1] to worker k + 1
+    bool sockets_ok = true;
+    for (int k = 0; k < procs && sockets_ok; k++) {
+        int control[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, control) < 0) {
+            sockets_ok = false;
+            break;
+        }
+        cluster->control[k] = control[0];
+        worker_ends[k] = control[1];
+
+        if (k + 1 < procs && socketpair(AF_UNIX, SOCK_STREAM, 0, &links[2 * k]) < 0)
+            sockets_ok = false;
+    }
+
+    if (!sockets_ok) {
+        for (int k = 0; k < procs; k++) {
+            close_fd(cluster->control[k]);
+            close_fd(worker_ends[k]);
+            close_fd(links[2 * k]);
+            close_fd(links[2 * k + 1]);
+            cluster->control[k] = -1;
+        }
+        free(links);
+        free(worker_ends);
+        cluster->procs = 0;
+        cluster_stop(cluster);
+        return false;
+    }
+
+    bool forked = true;
+    for (int k = 0; k < procs; k++) {
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            forked = false;
+            break;
+        }
+
+        if (pid == 0) {
+            int up = (k > 0) ? links[2 * (k - 1) + 1] : -1;
+            int down = (k + 1 < procs) ? links[2 * k] : -1;
+
+            for (int j = 0; j < procs; j++) {
+                close_fd(cluster->control[j]);
+                if (j != k)
+                    close_fd(worker_ends[j]);
+                if (links[2 * j] != down)
+                    close_fd(links[2 * j]);
+                if (links[2 * j + 1] != up)
+                    close_fd(links[2 * j + 1]);
+            }
+
+            _exit(worker_main(cluster, k, up, down, worker_ends[k]));
+        }
+
+        cluster->pids[k] = (int)pid;
+    }
+
+    for (int k = 0; k < procs; k++) {
+        close_fd(worker_ends[k]);
+        close_fd(links[2 * k]);
+        close_fd(links[2 * k + 1]);
+    }
+
+    free(links);
+    free(worker_ends);
+
+    // a partial cluster would leave a slab without a writer; the workers
+    // that did start are told to quit and reaped, and unstarted ones keep
+    // pid 0
+    if (!forked) {
+        cluster_stop(cluster);
+        return false;
+    }
+
+    return true;
+}
+
+void cluster_stop(Cluster *cluster) {
+    Message msg = { .kind = MSG_QUIT };
+
+    for (int k = 0; k < cluster->procs; k++) {
+        if (cluster->control[k] < 0)
+            continue;
+        write_all(cluster->control[k], &msg, sizeof(msg));
+        close(cluster->control[k]);
+    }
+
+    for (int k = 0; k < cluster->procs; k++) {
+        if (cluster->pids[k] > 0)
+            waitpid((pid_t)cluster->pids[k], NULL, 0);
+    }
+
+    free(cluster->slab_y);
+    free(cluster->pids);
+    free(cluster->control);
+    *cluster = (Cluster){ 0 };
+}
+
+static bool broadcast(Cluster *cluster, const Message *msg) {
+    for (int k = 0; k < cluster->procs; k++) {
+        if (!write_all(cluster->control[k], msg, sizeof(*msg)))
+            return false;
+    }
+    return true;
+}
+
+bool cluster_step(Cluster *cluster, int ticks) {
+    Message msg = { .kind = MSG_STEP, .value = ticks };
+    return broadcast(cluster, &msg);
+}
+
+bool cluster_edit(Cluster *cluster, const Command *command) {
+    Message msg = { .kind = MSG_EDIT, .command = *command };
+    return broadcast(cluster, &msg);
+}
+
+bool cluster_read_frame(Cluster *cluster, uint32_t *pixels, int row_pixels) {
+    Message msg = { .kind = MSG_FRAME };
+    int out_w = cluster->width / cluster->scale;
+
+    if (!broadcast(cluster, &msg))
+        return false;
+
+    for (int k = 0; k < cluster->procs; k++) {
+        int oy0 = cluster->slab_y[k] / cluster->scale;
+        int oy1 = cluster->slab_y[k + 1] / cluster->scale;
+
+        for (int oy = oy0; oy < oy1; oy++) {
+            if (!read_all(cluster->control[k], pixels + oy * row_pixels, out_w * sizeof(uint32_t)))
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#include "command.h"
+
+void command_queue_init(CommandQueue *queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+bool command_queue_push(CommandQueue *queue, const Command *command) {
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail - head == COMMAND_QUEUE_CAPACITY)
+        return false;
+
+    queue->slots[tail & (COMMAND_QUEUE_CAPACITY - 1)] = *command;
+
+    // publishes the slot to the consumer
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool command_queue_pop(CommandQueue *queue, Command *out) {
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head == tail)
+        return false;
+
+    *out = queue->slots[head & (COMMAND_QUEUE_CAPACITY - 1)];
+
+    // hands the slot back to the producer
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
@@ -3,6 +3,7 @@
 #include "particle.h"
 #include "simulation.h"
 #include <SDL3/SDL_events.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 
@@ -13,6 +14,20 @@ bool init() {
     game.height = WINDOW_HEIGHT;
     game.brush_size = 3;
     game.current_type = PARTICLE_SAND;
+    game.speed = 1;
+    game.tick_cap = SPEED_LIMIT;
+
+    if (game.world_scale < 1)
+        game.world_scale = 1;
+
+    // fork the workers before SDL starts any threads
+    if (game.procs > 1) {
+        if (!cluster_start(&game.cluster, game.procs, SIM_WIDTH * game.world_scale,
+                           SIM_HEIGHT * game.world_scale, game.world_scale)) {
+            fprintf(stderr, "Cluster start error\n");
+            return false;
+        }
+    }
 
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         SDL_Log("SDL init failed: %s", SDL_GetError());
@@ -72,11 +87,21 @@ bool init() {
         return false;
     }
 
-    if (!sim_init(&game.sim)) {
+    if (game.cluster.procs == 0 && !sim_init(&game.sim, SIM_WIDTH, SIM_HEIGHT)) {
         fprintf(stderr, "Simulation init error\n");
         return false;
     }
 
+    if (game.history_mb <= 0)
+        game.history_mb = 64;
+
+    if (game.cluster.procs == 0) {
+        if (history_init(&game.history, &game.sim, (size_t)game.history_mb << 20))
+            history_record(&game.history, &game.sim);
+        else
+            fprintf(stderr, "History init error, rewind disabled\n");
+    }
+
     game.running = true;
 
     return true;
@@ -97,6 +122,50 @@ void screen_to_sim(int screen_x, int screen_y, int *sim_x, int *sim_y) {
     *sim_y = (int)((screen_y - offset_y) / scale);
 }
 
+typedef struct {
+    Uint32 *pixels;
+    int row_pixels;
+} TextureRows;
+
+void write_texture_row(Simulation *sim, int y, void *user) {
+    TextureRows *texture = (TextureRows *)user;
+    Uint32 *row = texture->pixels + y * texture->row_pixels;
+
+    // walk the row one contiguous run at a time so tiled grids detile
+    // with a single index computation per tile
+    for (int x0 = 0; x0 < SIM_WIDTH; ) {
+        int run = sim_grid_run(sim, x0);
+        Particle **cells = sim->grid + sim_grid_index(sim, x0, y);
+
+        for (int i = 0; i < run; i++) {
+            Particle *p = cells[i];
+            row[x0 + i] = p ? color_pack(p->color) : 0x00000000;
+        }
+
+        x0 += run;
+    }
+}
+
+void record_tick() {
+    if (game.history.ring)
+        history_record(&game.history, &game.sim);
+}
+
+void scrub(int ticks) {
+    if (!game.history.ring)
+        return;
+
+    int target = game.sim.current_tick + ticks;
+    int first = history_first_tick(&game.history);
+    int last = history_last_tick(&game.history);
+
+    if (target < first) target = first;
+    if (target > last) target = last;
+
+    game.paused = true;
+    history_seek(&game.history, &game.sim, target);
+}
+
 void update_texture() {
     void *pixels;
     int pitch;
@@ -106,27 +175,19 @@ void update_texture() {
         return;
     }
 
-    Uint32 *pixel_buffer = (Uint32 *)pixels;
-    int row_pixels = pitch / sizeof(Uint32);
+    TextureRows texture = { (Uint32 *)pixels, pitch / sizeof(Uint32) };
 
-    for (int y = 0; y < SIM_HEIGHT; y++) {
-        Uint32 *row = pixel_buffer + y * row_pixels;
-        for (int x = 0; x < SIM_WIDTH; x++) {
-            row[x] = 0x00000000;
+    if (game.cluster.procs > 0) {
+        if (!cluster_read_frame(&game.cluster, texture.pixels, texture.row_pixels)) {
+            SDL_Log("Cluster frame lost");
+            game.running = false;
         }
-    }
-
-    for (int y = 0; y < SIM_HEIGHT; y++) {
-        Uint32 *row = pixel_buffer + y * row_pixels;
-        for (int x = 0; x < SIM_WIDTH; x++) {
-            Particle *p = game.sim.grid[y * SIM_WIDTH + x];
-
-            if (p) {
-                row[x] = (p->color.a << 24) |
-                         (p->color.b << 16) |
-                         (p->color.g << 8) |
-                         (p->color.r);
-            }
+    } else if (game.fused && !game.paused) {
+        sim_update_fused(&game.sim, write_texture_row, &texture);
+        record_tick();
+    } else {
+        for (int y = 0; y < SIM_HEIGHT; y++) {
+            write_texture_row(&game.sim, y, &texture);
         }
     }
 
@@ -157,6 +218,27 @@ void render_texture() {
     );
 }
 
+// edits are applied at the start of the next tick, by the workers in
+// multi-process mode
+void submit(const Command *command) {
+    if (game.cluster.procs > 0) {
+        int scale = game.world_scale;
+        Command scaled = *command;
+
+        scaled.x *= scale;
+        scaled.y *= scale;
+        scaled.x2 *= scale;
+        scaled.y2 *= scale;
+        scaled.radius *= scale;
+
+        cluster_edit(&game.cluster, &scaled);
+        return;
+    }
+
+    if (!command_queue_push(&game.sim.commands, command))
+        SDL_Log("Command queue full, dropping edit");
+}
+
 void handle_events() {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
@@ -181,6 +263,8 @@ void handle_events() {
                     game.mouse_left = true;
                 if (event.button.button == SDL_BUTTON_RIGHT)
                     game.mouse_right = true;
+                if (event.button.button == SDL_BUTTON_MIDDLE)
+                    game.mouse_middle = true;
                 break;
 
             case SDL_EVENT_MOUSE_BUTTON_UP:
@@ -188,6 +272,8 @@ void handle_events() {
                     game.mouse_left = false;
                 if (event.button.button == SDL_BUTTON_RIGHT)
                     game.mouse_right = false;
+                if (event.button.button == SDL_BUTTON_MIDDLE)
+                    game.mouse_middle = false;
                 break;
 
             case SDL_EVENT_MOUSE_WHEEL:
@@ -204,14 +290,42 @@ void handle_events() {
                     case SDLK_2:
                         game.current_type = PARTICLE_WATER;
                         break;
+                    case SDLK_3:
+                        game.current_type = PARTICLE_SMOKE;
+                        break;
+                    case SDLK_4:
+                        game.current_type = PARTICLE_GLASS;
+                        break;
+                    case SDLK_EQUALS:
+                        if (game.speed != SPEED_MAX)
+                            game.speed = (game.speed >= SPEED_LIMIT) ? SPEED_MAX : game.speed * 2;
+                        break;
+                    case SDLK_MINUS:
+                        if (game.speed == SPEED_MAX)
+                            game.speed = SPEED_LIMIT;
+                        else if (game.speed > 1)
+                            game.speed /= 2;
+                        break;
+                    case SDLK_T:
+                        game.speed = (game.speed == 1) ? SPEED_MAX : 1;
+                        break;
+                    case SDLK_F:
+                        game.fused = !game.fused;
+                        break;
+                    case SDLK_SPACE:
+                        game.paused = !game.paused;
+                        break;
+                    case SDLK_LEFT:
+                        scrub((event.key.mod & SDL_KMOD_SHIFT) ? -60 : -1);
+                        break;
+                    case SDLK_RIGHT:
+                        scrub((event.key.mod & SDL_KMOD_SHIFT) ? 60 : 1);
+                        break;
                     case SDLK_C:
-                        for (int i = 0; i < SIM_WIDTH * SIM_HEIGHT; i++) {
-                            if (game.sim.grid[i]) {
-                                int y = i / SIM_WIDTH;
-                                int x = i % SIM_WIDTH;
-                                sim_remove_particle(&game.sim, x, y);
-                            }
-                        }
+                        submit(&(Command){ .kind = COMMAND_CLEAR });
+                        break;
+                    case SDLK_R:
+                        submit(&(Command){ .kind = COMMAND_RESET });
                         break;
                 }
                 break;
@@ -223,19 +337,121 @@ void handle_input() {
     int sim_x, sim_y;
     screen_to_sim(game.mouse_x, game.mouse_y, &sim_x, &sim_y);
 
+    if (!game.stroking) {
+        game.stroke_x = sim_x;
+        game.stroke_y = sim_y;
+    }
+
+    Command line = {
+        .kind = COMMAND_LINE,
+        .x = game.stroke_x,
+        .y = game.stroke_y,
+        .x2 = sim_x,
+        .y2 = sim_y,
+        .radius = game.brush_size
+    };
+
     if (game.mouse_left) {
-        sim_brush_cirlce(&game.sim, sim_x, sim_y, game.brush_size, game.current_type);
+        line.type = game.current_type;
+        submit(&line);
     }
 
     if (game.mouse_right) {
-        sim_brush_erase(&game.sim, sim_x, sim_y, game.brush_size);
+        line.type = PARTICLE_NONE;
+        submit(&line);
+    }
+
+    if (game.mouse_middle) {
+        submit(&(Command){
+            .kind = COMMAND_HEAT,
+            .x = sim_x,
+            .y = sim_y,
+            .radius = game.brush_size,
+            .amount = 40.0f
+        });
     }
+
+    game.stroking = game.mouse_left || game.mouse_right;
+    game.stroke_x = sim_x;
+    game.stroke_y = sim_y;
 }
 
-void update() {
+void step_simulation(Uint64 deadline_ns) {
+    int ticks = 0;
+
+    if (game.cluster.procs > 0) {
+        // workers run the whole batch before replying, so the budget is
+        // enforced by adapting tick_cap between frames instead
+        ticks = game.tick_cap;
+        if (game.speed != SPEED_MAX && game.speed < ticks)
+            ticks = game.speed;
+        cluster_step(&game.cluster, ticks);
+    } else {
+        int limit = (game.speed == SPEED_MAX) ? INT_MAX : game.speed;
+
+        // in fused mode update_texture runs the frame's last tick
+        if (game.fused)
+            limit--;
+
+        while (ticks < limit) {
+            sim_update(&game.sim);
+            record_tick();
+            ticks++;
+
+            if (SDL_GetTicksNS() >= deadline_ns)
+                break;
+        }
+
+        if (game.fused)
+            ticks++;
+    }
+
+    game.frame_ticks = ticks;
+    game.tick_count += ticks;
+
+    Uint64 now = SDL_GetTicks();
+    if (now - game.tps_time >= 1000) {
+        game.ticks_per_second = (int)(game.tick_count * 1000 / (now - game.tps_time));
+        game.tick_count = 0;
+        game.tps_time = now;
+    }
+}
+
+void update(Uint64 deadline_ns) {
     handle_input();
-    sim_update(&game.sim);
+
+    if (game.paused) {
+        // no tick is coming, but edits should still show up
+        if (game.cluster.procs == 0)
+            sim_apply_commands(&game.sim);
+        game.frame_ticks = 0;
+    } else {
+        step_simulation(deadline_ns);
+    }
+
     update_texture();
+
+    if (game.cluster.procs > 0) {
+        if (SDL_GetTicksNS() > deadline_ns && game.tick_cap > 1)
+            game.tick_cap /= 2;
+        else if (game.frame_ticks == game.tick_cap && game.tick_cap < SPEED_LIMIT)
+            game.tick_cap *= 2;
+    }
+}
+
+void render_hud() {
+    char text[64];
+
+    if (game.paused)
+        SDL_snprintf(text, sizeof(text), "paused  tick %d  history %d..%d", game.sim.current_tick,
+                     history_first_tick(&game.history), history_last_tick(&game.history));
+    else if (game.speed == SPEED_MAX)
+        SDL_snprintf(text, sizeof(text), "speed max (%dx)  %d ticks/s", game.frame_ticks, game.ticks_per_second);
+    else
+        SDL_snprintf(text, sizeof(text), "speed %dx (%dx)  %d ticks/s", game.speed, game.frame_ticks, game.ticks_per_second);
+
+    SDL_SetRenderDrawColor(game.renderer, 255, 255, 255, 255);
+    SDL_RenderDebugText(game.renderer, 8, 8, text);
 }
 
 void draw() {
@@ -243,6 +459,7 @@ void draw() {
     SDL_RenderClear(game.renderer);
 
     render_texture();
+    render_hud();
 
     SDL_RenderPresent(game.renderer);
 }
@@ -250,6 +467,10 @@ void draw() {
 void run() {
     Uint64 last_time = SDL_GetTicks();
     const Uint64 FRAME_DELAY = 16;
+    // leave part of the frame for texture upload and present
+    const Uint64 TICK_BUDGET_NS = 12 * 1000000;
+
+    game.tps_time = last_time;
 
     while (game.running) {
         Uint64 current_time = SDL_GetTicks();
@@ -258,7 +479,7 @@ void run() {
         handle_events();
 
         if (elapsed >= FRAME_DELAY) {
-            update();
+            update(SDL_GetTicksNS() + TICK_BUDGET_NS);
             last_time = current_time;
         }
 
@@ -272,7 +493,11 @@ void run() {
 }
 
 void cleanup() {
-    sim_cleanup(&game.sim);
+    if (game.cluster.procs > 0)
+        cluster_stop(&game.cluster);
+    else
+        sim_cleanup(&game.sim);
+    history_cleanup(&game.history);
     SDL_DestroyTexture(game.texture);
     SDL_DestroyRenderer(game.renderer);
     SDL_DestroyWindow(game.window);
@@ -0,0 +1,391 @@
+#include "history.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline HistoryRecord *record_at(History *history, int i) {
+    return &history->records[(history->first + i) % HISTORY_MAX_RECORDS];
+}
+
+static inline int8_t quantize_velocity(float v) {
+    float q = v * HISTORY_VELOCITY_SCALE;
+
+    if (q > 127.0f) q = 127.0f;
+    if (q < -127.0f) q = -127.0f;
+
+    return (int8_t)(q < 0.0f ? q - 0.5f : q + 0.5f);
+}
+
+static inline HistoryCell cell_from_particle(const Particle *p) {
+    HistoryCell cell = { 0 };
+
+    if (p) {
+        memcpy(&cell.color, &p->color, sizeof(cell.color));
+        cell.type = (uint8_t)p->type;
+        cell.vx = quantize_velocity(p->vx);
+        cell.vy = quantize_velocity(p->vy);
+    }
+
+    return cell;
+}
+
+static inline Particle particle_from_cell(const HistoryCell *cell) {
+    Particle p = { 0 };
+
+    p.type = (ParticleType)cell->type;
+    memcpy(&p.color, &cell->color, sizeof(p.color));
+    p.vx = cell->vx / HISTORY_VELOCITY_SCALE;
+    p.vy = cell->vy / HISTORY_VELOCITY_SCALE;
+
+    return p;
+}
+
+static inline bool cells_equal(const HistoryCell *a, const HistoryCell *b) {
+    return a->bits == b->bits;
+}
+
+static inline void mark_dirty(History *history, int idx) {
+    if (!history->dirty_mark[idx]) {
+        history->dirty_mark[idx] = 1;
+        history->dirty[history->dirty_count++] = idx;
+    }
+}
+
+bool history_init(History *history, Simulation *sim, size_t budget) {
+    int cells = sim->width * sim->height;
+
+    if (!sim_track_changes(sim))
+        return false;
+
+    *history = (History){ 0 };
+    history->width = sim->width;
+    history->height = sim->height;
+    history->heat_cells = sim->heat_stride * (sim->heat_height + 2);
+    history->generation = sim->generation;
+
+    // worst case is a keyframe where every cell changed: a full delta plus
+    // a run of length one for every cell
+    size_t scratch_size = (size_t)cells * (sizeof(HistoryCell) + sizeof(uint32_t)) +
+                          (size_t)cells * (sizeof(HistoryCell) + sizeof(uint32_t)) +
+                          (size_t)history->heat_cells * sizeof(float);
+
+    // the per-cell working arrays, including the simulation's change list,
+    // come out of the budget and the ring gets the rest
+    size_t fixed = HISTORY_MAX_RECORDS * sizeof(HistoryRecord) + scratch_size +
+                   (size_t)cells * (sizeof(HistoryCell) + sizeof(int) + 1) +
+                   (size_t)cells * (sizeof(int) + 1);
+
+    if (budget < fixed + scratch_size)
+        return false;
+    history->ring_size = budget - fixed;
+
+    history->ring = (uint8_t *)malloc(history->ring_size);
+    history->records = (HistoryRecord *)malloc(HISTORY_MAX_RECORDS * sizeof(HistoryRecord));
+    history->shadow = (HistoryCell *)calloc(cells, sizeof(HistoryCell));
+    history->scratch = (uint8_t *)malloc(scratch_size);
+    history->dirty = (int *)malloc(cells * sizeof(int));
+    history->dirty_mark = (uint8_t *)calloc(cells, 1);
+
+    if (!history->ring || !history->records || !history->shadow ||
+        !history->scratch || !history->dirty || !history->dirty_mark) {
+        history_cleanup(history);
+        return false;
+    }
+
+    return true;
+}
+
+void history_cleanup(History *history) {
+    free(history->ring);
+    free(history->records);
+    free(history->shadow);
+    free(history->scratch);
+    free(history->dirty);
+    free(history->dirty_mark);
+
+    *history = (History){ 0 };
+}
+
+int history_first_tick(const History *history) {
+    if (history->count == 0)
+        return 0;
+    return history->records[history->first].tick;
+}
+
+int history_last_tick(const History *history) {
+    if (history->count == 0)
+        return 0;
+    return history->records[(history->first + history->count - 1) % HISTORY_MAX_RECORDS].tick;
+}
+
+static inline void put_u32(uint8_t **out, uint32_t value) {
+    memcpy(*out, &value, sizeof(value));
+    *out += sizeof(value);
+}
+
+static inline uint32_t get_u32(const uint8_t **in) {
+    uint32_t value;
+    memcpy(&value, *in, sizeof(value));
+    *in += sizeof(value);
+    return value;
+}
+
+static inline uint8_t *put_change(History *history, uint8_t *out, int cell, const HistoryCell *value) {
+    HistoryCell *prev = &history->shadow[cell];
+    uint64_t diff = value->bits ^ prev->bits;
+    *prev = *value;
+
+    put_u32(&out, (uint32_t)cell);
+    memcpy(out, &diff, sizeof(diff));
+    return out + sizeof(diff);
+}
+
+// [cell][XORed value] for each cell the simulation touched; the first
+// record has nothing to diff against and scans the whole grid
+static uint8_t *encode_delta(History *history, Simulation *sim, uint8_t *out) {
+    if (history->count == 0) {
+        for (int y = 0; y < history->height; y++) {
+            for (int x = 0; x < history->width; x++) {
+                int idx = y * history->width + x;
+                HistoryCell cell = cell_from_particle(sim->grid[sim_grid_index(sim, x, y)]);
+                if (!cells_equal(&cell, &history->shadow[idx]))
+                    out = put_change(history, out, idx, &cell);
+            }
+        }
+    } else {
+        for (int i = 0; i < sim->changed_count; i++) {
+            int idx = sim->changed[i];
+            int x = idx % history->width;
+            int y = idx / history->width;
+            HistoryCell cell = cell_from_particle(sim->grid[sim_grid_index(sim, x, y)]);
+            if (!cells_equal(&cell, &history->shadow[idx]))
+                out = put_change(history, out, idx, &cell);
+        }
+    }
+
+    sim_reset_changes(sim);
+    return out;
+}
+
+static void apply_delta(History *history, const uint8_t *in, size_t size) {
+    const uint8_t *end = in + size;
+
+    while (in < end) {
+        int idx = (int)get_u32(&in);
+        uint64_t diff;
+        memcpy(&diff, in, sizeof(diff));
+        in += sizeof(diff);
+
+        history->shadow[idx].bits ^= diff;
+        mark_dirty(history, idx);
+    }
+}
+
+// runs of identical cells: [count][cell], then the heat field
+static uint8_t *encode_keyframe(History *history, Simulation *sim, uint8_t *out) {
+    int cells = history->width * history->height;
+    int i = 0;
+
+    while (i < cells) {
+        uint32_t run = 1;
+        while (i + (int)run < cells && cells_equal(&history->shadow[i + run], &history->shadow[i]))
+            run++;
+
+        put_u32(&out, run);
+        memcpy(out, &history->shadow[i], sizeof(HistoryCell));
+        out += sizeof(HistoryCell);
+        i += (int)run;
+    }
+
+    memcpy(out, sim->heat, history->heat_cells * sizeof(float));
+    return out + history->heat_cells * sizeof(float);
+}
+
+static void apply_keyframe(History *history, const uint8_t *in) {
+    int cells = history->width * history->height;
+    int i = 0;
+
+    while (i < cells) {
+        uint32_t run = get_u32(&in);
+        HistoryCell cell;
+        memcpy(&cell, in, sizeof(cell));
+        in += sizeof(cell);
+
+        for (uint32_t j = 0; j < run; j++, i++) {
+            if (!cells_equal(&history->shadow[i], &cell)) {
+                history->shadow[i] = cell;
+                mark_dirty(history, i);
+            }
+        }
+    }
+}
+
+static void drop_oldest(History *history) {
+    history->first = (history->first + 1) % HISTORY_MAX_RECORDS;
+    history->count--;
+    history->cursor--;
+}
+
+// records are never split across the end of the ring; when one does not
+// fit in the tail it starts again at offset 0
+static bool reserve(History *history, size_t size, size_t *offset) {
+    if (size > history->ring_size)
+        return false;
+
+    if (history->count == HISTORY_MAX_RECORDS)
+        drop_oldest(history);
+
+    while (history->count > 0) {
+        size_t tail = record_at(history, 0)->offset;
+        HistoryRecord *last = record_at(history, history->count - 1);
+        size_t head = last->offset + last->size;
+
+        if (last->offset >= tail) {
+            if (head + size <= history->ring_size) {
+                *offset = head;
+                return true;
+            }
+            if (size <= tail) {
+                *offset = 0;
+                return true;
+            }
+        } else if (head + size <= tail) {
+            *offset = head;
+            return true;
+        }
+
+        drop_oldest(history);
+    }
+
+    *offset = 0;
+    return true;
+}
+
+// a reset bypasses change tracking, so nothing recorded so far can be
+// stepped to or from the new world
+static void restart(History *history, Simulation *sim) {
+    memset(history->shadow, 0, (size_t)history->width * history->height * sizeof(HistoryCell));
+    history->first = 0;
+    history->count = 0;
+    history->cursor = 0;
+    history->generation = sim->generation;
+}
+
+bool history_record(History *history, Simulation *sim) {
+    if (history->generation != sim->generation)
+        restart(history, sim);
+
+    if (history->count > 0 && history->cursor < history->count - 1)
+        history->count = history->cursor + 1;
+
+    bool keyframe = history->count == 0 || sim->current_tick % HISTORY_KEYFRAME_INTERVAL == 0;
+
+    uint8_t *delta_end = encode_delta(history, sim, history->scratch);
+    uint8_t *end = keyframe ? encode_keyframe(history, sim, delta_end) : delta_end;
+    size_t size = (size_t)(end - history->scratch);
+
+    size_t offset;
+    if (!reserve(history, size, &offset)) {
+        history->count = 0;
+        history->cursor = -1;
+        return false;
+    }
+
+    memcpy(history->ring + offset, history->scratch, size);
+
+    HistoryRecord *record = record_at(history, history->count);
+    record->tick = sim->current_tick;
+    record->rng_state = sim->rng_state;
+    record->keyframe = keyframe;
+    record->offset = offset;
+    record->delta_size = (size_t)(delta_end - history->scratch);
+    record->size = size;
+
+    history->count++;
+    history->cursor = history->count - 1;
+    return true;
+}
+
+static int nearest_keyframe(History *history, int target) {
+    for (int d = 0; d < history->count; d++) {
+        if (target - d >= 0 && record_at(history, target - d)->keyframe)
+            return target - d;
+        if (target + d < history->count && record_at(history, target + d)->keyframe)
+            return target + d;
+    }
+    return -1;
+}
+
+static int keyframe_at_or_before(History *history, int target) {
+    for (int i = target; i >= 0; i--) {
+        if (record_at(history, i)->keyframe)
+            return i;
+    }
+    return -1;
+}
+
+bool history_seek(History *history, Simulation *sim, int tick) {
+    if (history->generation != sim->generation)
+        restart(history, sim);
+
+    if (history->count == 0)
+        return false;
+
+    int target = tick - history_first_tick(history);
+    if (target < 0 || target >= history->count)
+        return false;
+
+    history->dirty_count = 0;
+
+    // edits made since the last record have to be undone as well
+    for (int i = 0; i < sim->changed_count; i++) {
+        mark_dirty(history, sim->changed[i]);
+    }
+
+    int current = history->cursor;
+    int key = nearest_keyframe(history, target);
+    int key_distance = abs(target - key) + HISTORY_KEYFRAME_INTERVAL / 2;
+
+    if (key >= 0 && key_distance < abs(target - current)) {
+        HistoryRecord *record = record_at(history, key);
+        apply_keyframe(history, history->ring + record->offset + record->delta_size);
+        current = key;
+    }
+
+    while (current < target) {
+        current++;
+        HistoryRecord *record = record_at(history, current);
+        apply_delta(history, history->ring + record->offset, record->delta_size);
+    }
+
+    while (current > target) {
+        HistoryRecord *record = record_at(history, current);
+        apply_delta(history, history->ring + record->offset, record->delta_size);
+        current--;
+    }
+
+    for (int i = 0; i < history->dirty_count; i++) {
+        int idx = history->dirty[i];
+        Particle p = particle_from_cell(&history->shadow[idx]);
+
+        sim_write_cell(sim, idx % history->width, idx / history->width, &p);
+        history->dirty_mark[idx] = 0;
+    }
+    history->dirty_count = 0;
+    sim_reset_changes(sim);
+
+    // the heat field is only kept in keyframes
+    int heat_key = keyframe_at_or_before(history, target);
+    if (heat_key >= 0) {
+        HistoryRecord *record = record_at(history, heat_key);
+        const uint8_t *heat = history->ring + record->offset + record->size -
+                              history->heat_cells * sizeof(float);
+        memcpy(sim->heat, heat, history->heat_cells * sizeof(float));
+    }
+
+    HistoryRecord *record = record_at(history, target);
+    sim->current_tick = record->tick;
+    sim->rng_state = record->rng_state;
+    history->cursor = target;
+
+    return true;
+}
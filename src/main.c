@@ -1,6 +1,17 @@
 #include "game.h"
+#include <stdlib.h>
+#include <string.h>
 
 int main(int argc, char* argv[]) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--procs") == 0)
+            game.procs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--scale") == 0)
+            game.world_scale = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--history-mb") == 0)
+            game.history_mb = atoi(argv[++i]);
+    }
+
     if (!init()) {
         return 1;
     }
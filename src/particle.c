@@ -11,13 +11,37 @@ static const ParticleProperties PARTICLE_PROPERTIES[PARTICLE_COUNT] = {
         .name = "Sand",
         .state = STATE_POWDER,
         .density = 1600.0f,
-        .viscosity = 0.0f
+        .viscosity = 0.0f,
+        .hot_point = 600.0f,
+        .hot_type = PARTICLE_GLASS
     },
     {
         .name = "Water",
         .state = STATE_LIQUID,
         .density = 1000.0f,
-        .viscosity = 0.1f
+        .viscosity = 0.1f,
+        .hot_point = 80.0f,
+        .hot_type = PARTICLE_STEAM
+    },
+    {
+        .name = "Steam",
+        .state = STATE_GAS,
+        .density = 0.6f,
+        .viscosity = 0.0f,
+        .cold_point = 60.0f,
+        .cold_type = PARTICLE_WATER
+    },
+    {
+        .name = "Glass",
+        .state = STATE_SOLID,
+        .density = 2500.0f,
+        .viscosity = 0.0f
+    },
+    {
+        .name = "Smoke",
+        .state = STATE_GAS,
+        .density = 1.1f,
+        .viscosity = 0.5f
     }
 };
 
@@ -36,6 +60,12 @@ Color get_color(ParticleType type) {
             return COLOR_SAND;
         case PARTICLE_WATER:
             return COLOR_WATER;
+        case PARTICLE_STEAM:
+            return COLOR_STEAM;
+        case PARTICLE_GLASS:
+            return COLOR_GLASS;
+        case PARTICLE_SMOKE:
+            return COLOR_SMOKE;
         default:
             return COLOR_AIR;
     }
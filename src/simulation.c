@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <time.h>
 
+#define SIM_CACHE_LINE 64
+
 static unsigned int rng_xorshift(Simulation *sim) {
     sim->rng_state ^= sim->rng_state << 13;
     sim->rng_state ^= sim->rng_state >> 17;
@@ -11,65 +13,240 @@ static unsigned int rng_xorshift(Simulation *sim) {
     return sim->rng_state;
 }
 
-bool sim_init(Simulation *sim) {
-    sim->width = SIM_WIDTH;
-    sim->height = SIM_HEIGHT;
+bool sim_init(Simulation *sim, int width, int height) {
+    sim->width = width;
+    sim->height = height;
     sim->rng_state = (unsigned int)time(NULL);
-
-    sim->grid = (Particle **)calloc(SIM_WIDTH * SIM_HEIGHT, sizeof(Particle *));
-    if (!sim->grid)
+    sim->rows_begin = 0;
+    sim->rows_end = height;
+    sim->defer_begin = 0;
+    sim->defer_end = 0;
+    command_queue_init(&sim->commands);
+
+#ifdef SIM_TILED
+    sim->tiles_x = (width + SIM_TILE_WIDTH - 1) >> SIM_TILE_WIDTH_SHIFT;
+    int tiles_y = (height + SIM_TILE_HEIGHT - 1) >> SIM_TILE_HEIGHT_SHIFT;
+    size_t grid_cells = (size_t)(sim->tiles_x * tiles_y) << (SIM_TILE_WIDTH_SHIFT + SIM_TILE_HEIGHT_SHIFT);
+#else
+    sim->tiles_x = 0;
+    size_t grid_cells = (size_t)width * height;
+#endif
+
+    sim->active_words = (width + 63) / 64;
+
+    sim->heat_width = (width + HEAT_CELL_SIZE - 1) >> HEAT_CELL_SHIFT;
+    sim->heat_height = (height + HEAT_CELL_SIZE - 1) >> HEAT_CELL_SHIFT;
+    sim->heat_stride = sim->heat_width + 2;
+
+    size_t cells = (size_t)width * height;
+    size_t grid_size = grid_cells * sizeof(Particle *);
+    size_t pool_size = cells * sizeof(Particle);
+    size_t free_size = cells * sizeof(int);
+    size_t active_size = (size_t)sim->active_words * height * sizeof(uint64_t);
+    size_t rows_size = (size_t)height * sizeof(int);
+    size_t heat_size = (size_t)sim->heat_stride * (sim->heat_height + 2) * sizeof(float);
+    size_t changed_size = cells * sizeof(int) + cells;
+
+    // room for change tracking is reserved up front but only carved, and
+    // its pages only touched, by sim_track_changes
+    size_t total = grid_size + pool_size + free_size + active_size + rows_size +
+                   2 * heat_size + changed_size + 9 * SIM_CACHE_LINE;
+
+    if (!arena_init(&sim->arena, total))
         return false;
 
-    int max_particles = SIM_WIDTH * SIM_HEIGHT;
-    sim->pool = (Particle *)malloc(max_particles * sizeof(Particle));
-    sim->free_list = (int *)malloc(max_particles * sizeof(int));
-
-    if (!sim->pool || !sim->free_list) {
-        sim_cleanup(sim);
-        return false;
-    }
-
-    sim->free_count = max_particles;
-    for (int i = 0; i < max_particles; i++) {
-        sim->free_list[i] = i;
-    }
+    // fresh pages read as zero: an empty grid, no active cells and
+    // ambient heat, with no loop over any of it
+    sim->grid = (Particle **)arena_push(&sim->arena, grid_size, SIM_CACHE_LINE);
+    sim->pool = (Particle *)arena_push(&sim->arena, pool_size, SIM_CACHE_LINE);
+    sim->free_list = (int *)arena_push(&sim->arena, free_size, SIM_CACHE_LINE);
+    sim->active = (uint64_t *)arena_push(&sim->arena, active_size, SIM_CACHE_LINE);
+    sim->row_active = (int *)arena_push(&sim->arena, rows_size, SIM_CACHE_LINE);
+    sim->heat = (float *)arena_push(&sim->arena, heat_size, SIM_CACHE_LINE);
+    sim->heat_back = (float *)arena_push(&sim->arena, heat_size, SIM_CACHE_LINE);
+
+    sim->pool_used = 0;
+    sim->free_count = 0;
+    sim->current_tick = 0;
+    sim->generation = 0;
+
+    // carved later by sim_track_changes, which checks changed first
+    sim->changed = NULL;
+    sim->changed_mark = NULL;
+    sim->changed_count = 0;
 
     return true;
 }
 
 void sim_cleanup(Simulation *sim) {
-    free(sim->grid);
-    free(sim->pool);
-    free(sim->free_list);
+    arena_release(&sim->arena);
 
     sim->grid = NULL;
     sim->pool = NULL;
     sim->free_list = NULL;
+    sim->active = NULL;
+    sim->row_active = NULL;
+    sim->heat = NULL;
+    sim->heat_back = NULL;
+    sim->changed = NULL;
+    sim->changed_mark = NULL;
+    sim->changed_count = 0;
+}
+
+void sim_reset(Simulation *sim) {
+    arena_zero(&sim->arena);
+
+    sim->pool_used = 0;
+    sim->free_count = 0;
+    sim->changed_count = 0;
+    sim->generation++;
+}
+
+bool sim_track_changes(Simulation *sim) {
+    if (sim->changed)
+        return true;
+
+    size_t cells = (size_t)sim->width * sim->height;
+    int *changed = (int *)arena_push(&sim->arena, cells * sizeof(int), SIM_CACHE_LINE);
+    unsigned char *changed_mark = (unsigned char *)arena_push(&sim->arena, cells, SIM_CACHE_LINE);
+
+    if (!changed || !changed_mark)
+        return false;
+
+    sim->changed = changed;
+    sim->changed_mark = changed_mark;
+    sim->changed_count = 0;
+    return true;
+}
+
+void sim_reset_changes(Simulation *sim) {
+    for (int i = 0; i < sim->changed_count; i++) {
+        sim->changed_mark[sim->changed[i]] = 0;
+    }
+    sim->changed_count = 0;
 }
 
-static inline int get_grid_idx(int x, int y) {
-    return y * SIM_WIDTH + x;
+static inline int get_grid_idx(const Simulation *sim, int x, int y) {
+    return sim_grid_index(sim, x, y);
 }
 
-static inline bool in_bounds(int x, int y) {
-    return x >= 0 && x < SIM_WIDTH && y >= 0 && y < SIM_HEIGHT;
+static inline bool in_bounds(const Simulation *sim, int x, int y) {
+    return x >= 0 && x < sim->width && y >= sim->rows_begin && y < sim->rows_end;
 }
 
 static inline Particle* get_particle(Simulation *sim, int x, int y) {
-    if (!in_bounds(x, y))
+    if (!in_bounds(sim, x, y))
         return NULL;
-    return sim->grid[get_grid_idx(x, y)];
+    return sim->grid[get_grid_idx(sim, x, y)];
+}
+
+static inline void mark_changed(Simulation *sim, int x, int y) {
+    if (!sim->changed_mark)
+        return;
+
+    int cell = y * sim->width + x;
+    if (!sim->changed_mark[cell]) {
+        sim->changed_mark[cell] = 1;
+        sim->changed[sim->changed_count++] = cell;
+    }
+}
+
+// solids without a heat transition never change on their own, so they stay
+// out of the active set until something writes to their cell
+static inline bool is_active(const Particle *p) {
+    if (!p)
+        return false;
+
+    const ParticleProperties *props = particles_get_properties(p->type);
+    return props->state != STATE_SOLID ||
+           props->hot_type != PARTICLE_NONE ||
+           props->cold_type != PARTICLE_NONE;
+}
+
+static inline uint64_t *active_row(const Simulation *sim, int y) {
+    return sim->active + (size_t)y * sim->active_words;
+}
+
+static inline void flip_active(Simulation *sim, int x, int y, int delta) {
+    active_row(sim, y)[x >> 6] ^= 1ULL << (x & 63);
+    sim->row_active[y] += delta;
+}
+
+// first active column at or after x, or width if there is none
+static inline int next_active(const Simulation *sim, int x, int y) {
+    const uint64_t *row = active_row(sim, y);
+    int word = x >> 6;
+
+    if (word >= sim->active_words)
+        return sim->width;
+
+    uint64_t bits = row[word] & (~0ULL << (x & 63));
+    while (!bits) {
+        if (++word == sim->active_words)
+            return sim->width;
+        bits = row[word];
+    }
+
+    return (word << 6) + __builtin_ctzll(bits);
+}
+
+// last active column at or before x, or -1 if there is none
+static inline int prev_active(const Simulation *sim, int x, int y) {
+    if (x < 0)
+        return -1;
+
+    const uint64_t *row = active_row(sim, y);
+    int word = x >> 6;
+
+    uint64_t bits = row[word] & (~0ULL >> (63 - (x & 63)));
+    while (!bits) {
+        if (--word < 0)
+            return -1;
+        bits = row[word];
+    }
+
+    return (word << 6) + 63 - __builtin_clzll(bits);
 }
 
 static inline void set_particle(Simulation *sim, int x, int y, Particle *p) {
-    if (!in_bounds(x, y))
+    if (!in_bounds(sim, x, y))
         return;
-    sim->grid[get_grid_idx(x, y)] = p;
+
+    int idx = get_grid_idx(sim, x, y);
+    bool was_active = is_active(sim->grid[idx]);
+    if (was_active != is_active(p))
+        flip_active(sim, x, y, was_active ? -1 : 1);
+
+    sim->grid[idx] = p;
+    mark_changed(sim, x, y);
+}
+
+// for a particle whose type changed in place
+static inline void refresh_active(Simulation *sim, int x, int y, bool was_active) {
+    if (was_active != is_active(get_particle(sim, x, y)))
+        flip_active(sim, x, y, was_active ? -1 : 1);
+}
+
+static inline float *heat_cell(Simulation *sim, int hx, int hy) {
+    return &sim->heat[(hy + 1) * sim->heat_stride + hx + 1];
+}
+
+static inline float sample_heat(Simulation *sim, int x, int y) {
+    return *heat_cell(sim, x >> HEAT_CELL_SHIFT, y >> HEAT_CELL_SHIFT);
 }
 
 static void swap_particles(Simulation *sim, int x1, int y1, int x2, int y2) {
-    int idx1 = get_grid_idx(x1, y1);
-    int idx2 = get_grid_idx(x2, y2);
+    int idx1 = get_grid_idx(sim, x1, y1);
+    int idx2 = get_grid_idx(sim, x2, y2);
+
+    mark_changed(sim, x1, y1);
+    mark_changed(sim, x2, y2);
+
+    // solids are never displaced, so any particle being swapped is active
+    if (!sim->grid[idx1] != !sim->grid[idx2]) {
+        flip_active(sim, x1, y1, sim->grid[idx1] ? -1 : 1);
+        flip_active(sim, x2, y2, sim->grid[idx2] ? -1 : 1);
+    }
 
     Particle *temp = sim->grid[idx1];
     sim->grid[idx1] = sim->grid[idx2];
@@ -77,11 +254,17 @@ static void swap_particles(Simulation *sim, int x1, int y1, int x2, int y2) {
 }
 
 bool sim_spawn_particles(Simulation *sim, int x, int y, ParticleType type) {
-    if (!in_bounds(x, y) || get_particle(sim, x, y) || sim->free_count == 0) {
+    if (!in_bounds(sim, x, y) || get_particle(sim, x, y))
+        return false;
+
+    int idx;
+    if (sim->free_count > 0)
+        idx = sim->free_list[--sim->free_count];
+    else if (sim->pool_used < sim->width * sim->height)
+        idx = sim->pool_used++;
+    else
         return false;
-    }
 
-    int idx = sim->free_list[--sim->free_count];
     Particle *p = &sim->pool[idx];
 
     *p = particle_create(type);
@@ -100,6 +283,42 @@ void sim_remove_particle(Simulation *sim, int x, int y) {
     set_particle(sim, x, y, NULL);
 }
 
+void sim_read_cell(Simulation *sim, int x, int y, Particle *out) {
+    Particle *p = get_particle(sim, x, y);
+    if (p) {
+        *out = *p;
+    } else {
+        *out = (Particle){ 0 };
+    }
+}
+
+void sim_write_cell(Simulation *sim, int x, int y, const Particle *src) {
+    if (src->type == PARTICLE_NONE) {
+        sim_remove_particle(sim, x, y);
+        return;
+    }
+
+    Particle *p = get_particle(sim, x, y);
+    if (!p) {
+        if (!sim_spawn_particles(sim, x, y, src->type))
+            return;
+        p = get_particle(sim, x, y);
+    }
+
+    bool was_active = is_active(p);
+    *p = *src;
+    refresh_active(sim, x, y, was_active);
+    mark_changed(sim, x, y);
+}
+
+void sim_clear(Simulation *sim) {
+    for (int y = 0; y < sim->height; y++) {
+        for (int x = 0; x < sim->width; x++) {
+            sim_remove_particle(sim, x, y);
+        }
+    }
+}
+
 static bool can_displace(Particle *a, Particle* b) {
     if (!a)
         return false;
@@ -134,7 +353,7 @@ static void update_powder(Simulation *sim, int x, int y) {
     if (move_y < 1) move_y = 1;
 
     for (int i = move_y; i >= 1; i--) {
-        if (in_bounds(x, y + i)) {
+        if (in_bounds(sim, x, y + i)) {
             Particle *below = get_particle(sim, x, y + i);
             if (can_displace(p, below)) {
                 swap_particles(sim, x, y, x, y + i);
@@ -145,7 +364,7 @@ static void update_powder(Simulation *sim, int x, int y) {
 
     int dir = (rng_xorshift(sim) % 2) ? -1 : 1;
 
-    if (in_bounds(x + dir, y + 1)) {
+    if (in_bounds(sim, x + dir, y + 1)) {
         Particle *diag = get_particle(sim, x + dir, y + 1);
         if (can_displace(p, diag)) {
             swap_particles(sim, x, y, x + dir, y + 1);
@@ -154,7 +373,7 @@ static void update_powder(Simulation *sim, int x, int y) {
         }
     }
 
-    if (in_bounds(x - dir, y + 1)) {
+    if (in_bounds(sim, x - dir, y + 1)) {
         Particle *diag = get_particle(sim, x - dir, y + 1);
         if (can_displace(p, diag)) {
             swap_particles(sim, x, y, x - dir, y + 1);
@@ -165,6 +384,8 @@ static void update_powder(Simulation *sim, int x, int y) {
 
     p->vy *= 0.5f;
     p->vx *= 0.8f;
+    if (p->vx > -VELOCITY_REST && p->vx < VELOCITY_REST)
+        p->vx = 0.0f;
 }
 
 static void update_liquid(Simulation *sim, int x, int y) {
@@ -183,7 +404,7 @@ static void update_liquid(Simulation *sim, int x, int y) {
     if (move_y < 1) move_y = 1;
 
     for (int i = move_y; i >= 1; i--) {
-        if (in_bounds(x, y + i)) {
+        if (in_bounds(sim, x, y + i)) {
             Particle *below = get_particle(sim, x, y + i);
             if (can_displace(p, below)) {
                 swap_particles(sim, x, y, x, y + i);
@@ -194,16 +415,20 @@ static void update_liquid(Simulation *sim, int x, int y) {
 
     int dir = (rng_xorshift(sim) % 2) ? -1 : 1;
 
-    Particle *diag1 = get_particle(sim, x + dir, y + 1);
-    if (can_displace(p, diag1)) {
-        swap_particles(sim, x, y, x + dir, y + 1);
-        return;
+    if (in_bounds(sim, x + dir, y + 1)) {
+        Particle *diag1 = get_particle(sim, x + dir, y + 1);
+        if (can_displace(p, diag1)) {
+            swap_particles(sim, x, y, x + dir, y + 1);
+            return;
+        }
     }
 
-    Particle *diag2 = get_particle(sim, x - dir, y + 1);
-    if (can_displace(p, diag2)) {
-        swap_particles(sim, x, y, x - dir, y + 1);
-        return;
+    if (in_bounds(sim, x - dir, y + 1)) {
+        Particle *diag2 = get_particle(sim, x - dir, y + 1);
+        if (can_displace(p, diag2)) {
+            swap_particles(sim, x, y, x - dir, y + 1);
+            return;
+        }
     }
 
     int flow_distance = (int)(3.0f * (1.0f - props->viscosity)) + 1;
@@ -216,7 +441,7 @@ static void update_liquid(Simulation *sim, int x, int y) {
             int nx = x + i * current_dir;
             Particle *side = get_particle(sim, nx, y);
 
-            if (!in_bounds(nx, y)) break;
+            if (!in_bounds(sim, nx, y)) break;
 
             if (can_displace(p, side)) {
                 swap_particles(sim, x, y, nx, y);
@@ -230,6 +455,81 @@ static void update_liquid(Simulation *sim, int x, int y) {
 
     p->vy *= 0.3f;
     p->vx *= 0.9f;
+    if (p->vx > -VELOCITY_REST && p->vx < VELOCITY_REST)
+        p->vx = 0.0f;
+}
+
+static bool can_rise(Particle *gas, Particle *above) {
+    if (!above)
+        return true;
+
+    const ParticleProperties *props_gas = particles_get_properties(gas->type);
+    const ParticleProperties *props_above = particles_get_properties(above->type);
+
+    return props_above->state == STATE_GAS && props_above->density > props_gas->density;
+}
+
+// gases only move into rows the bottom-up sweep has not reached yet, where
+// the updated flag stops them being processed a second time; denser
+// particles above sink through them in their own update
+static void update_gas(Simulation *sim, int x, int y) {
+    Particle *p = get_particle(sim, x, y);
+    if (!p) return;
+
+    const ParticleProperties *props = particles_get_properties(p->type);
+
+    p->vy -= GRAVITY;
+
+    if (p->vy < -4.0f) p->vy = -4.0f;
+    if (p->vx > 2.0f) p->vx = 2.0f;
+    if (p->vx < -2.0f) p->vx = -2.0f;
+
+    int move_y = (int)-p->vy;
+    if (move_y < 1) move_y = 1;
+
+    // nearest first so a gas cannot tunnel through a thin lid
+    int rise = 0;
+    while (rise < move_y && in_bounds(sim, x, y - rise - 1) &&
+           can_rise(p, get_particle(sim, x, y - rise - 1)))
+        rise++;
+
+    if (rise > 0) {
+        swap_particles(sim, x, y, x, y - rise);
+        return;
+    }
+
+    int dir = (rng_xorshift(sim) % 2) ? -1 : 1;
+
+    if (in_bounds(sim, x + dir, y - 1)) {
+        Particle *diag1 = get_particle(sim, x + dir, y - 1);
+        if (can_rise(p, diag1)) {
+            swap_particles(sim, x, y, x + dir, y - 1);
+            return;
+        }
+    }
+
+    if (in_bounds(sim, x - dir, y - 1)) {
+        Particle *diag2 = get_particle(sim, x - dir, y - 1);
+        if (can_rise(p, diag2)) {
+            swap_particles(sim, x, y, x - dir, y - 1);
+            return;
+        }
+    }
+
+    // viscous gases such as smoke spread sideways less often
+    if ((rng_xorshift(sim) % 100) >= (unsigned int)(props->viscosity * 100.0f)) {
+        int nx = x + dir;
+        if (in_bounds(sim, nx, y) && !get_particle(sim, nx, y)) {
+            swap_particles(sim, x, y, nx, y);
+            p->vx = (float)dir;
+            return;
+        }
+    }
+
+    p->vy *= 0.5f;
+    p->vx *= 0.8f;
+    if (p->vx > -VELOCITY_REST && p->vx < VELOCITY_REST)
+        p->vx = 0.0f;
 }
 
 // static void update_sand(Simulation *sim, int x, int y) {
@@ -280,14 +580,62 @@ static void update_liquid(Simulation *sim, int x, int y) {
 //     }
 // }
 
+static void transform_particle(Particle *p, ParticleType type) {
+    Particle next = particle_create(type);
+    next.vx = p->vx;
+    next.vy = p->vy;
+    next.updated = p->updated;
+    *p = next;
+}
+
+static const ParticleProperties* apply_heat(Simulation *sim, Particle *p, int x, int y) {
+    const ParticleProperties *props = particles_get_properties(p->type);
+    if (props->hot_type == PARTICLE_NONE && props->cold_type == PARTICLE_NONE)
+        return props;
+
+    float heat = sample_heat(sim, x, y);
+
+    if (props->hot_type != PARTICLE_NONE && heat >= props->hot_point) {
+        transform_particle(p, props->hot_type);
+    } else if (props->cold_type != PARTICLE_NONE && heat < props->cold_point) {
+        transform_particle(p, props->cold_type);
+    } else {
+        return props;
+    }
+
+    refresh_active(sim, x, y, true);
+    mark_changed(sim, x, y);
+    return particles_get_properties(p->type);
+}
+
+// a sweep that is split into pieces can reach a particle before the one
+// it rests on; settling then would brake it against a cell that is about
+// to empty
+static bool waits_on_below(Simulation *sim, Particle *p, int x, int y) {
+    if (y + 1 < sim->defer_begin || y + 1 >= sim->defer_end)
+        return false;
+
+    ParticleState state = particles_get_properties(p->type)->state;
+    if (state != STATE_POWDER && state != STATE_LIQUID)
+        return false;
+
+    Particle *below = get_particle(sim, x, y + 1);
+    return is_active(below) && !below->updated && !can_displace(p, below);
+}
+
 void update_particle(Simulation *sim, int x, int y) {
     Particle *p = get_particle(sim, x, y);
     if (!p || p->updated)
         return;
 
+    if (waits_on_below(sim, p, x, y))
+        return;
+
     p->updated = true;
 
-    const ParticleProperties *props = particles_get_properties(p->type);
+    const ParticleProperties *props = apply_heat(sim, p, x, y);
+    float vx = p->vx;
+    float vy = p->vy;
 
     switch (props->state) {
         case STATE_POWDER:
@@ -296,9 +644,80 @@ void update_particle(Simulation *sim, int x, int y) {
         case STATE_LIQUID:
             update_liquid(sim, x, y);
             break;
+        case STATE_GAS:
+            update_gas(sim, x, y);
+            break;
+        default:
+            break;
+    }
+
+    // moves are recorded by swap_particles, this catches particles at rest
+    if (p->vx != vx || p->vy != vy)
+        mark_changed(sim, x, y);
+}
+
+static void heat_fill_border(Simulation *sim) {
+    int w = sim->heat_width;
+    int h = sim->heat_height;
+    int stride = sim->heat_stride;
+    float *heat = sim->heat;
+
+    for (int hy = 1; hy <= h; hy++) {
+        heat[hy * stride] = heat[hy * stride + 1];
+        heat[hy * stride + w + 1] = heat[hy * stride + w];
+    }
+
+    for (int hx = 0; hx < stride; hx++) {
+        heat[hx] = heat[stride + hx];
+        heat[(h + 1) * stride + hx] = heat[h * stride + hx];
+    }
+}
+
+// GCC only trusts restrict on parameters, so the row gets its own function
+// to vectorise without a runtime overlap check; -O2 on GCC 12 does not
+// vectorise it at all, release builds use -O3
+static void heat_diffuse_row(float *restrict out, const float *restrict up,
+                             const float *restrict mid, const float *restrict down, int w) {
+    for (int hx = 0; hx < w; hx++) {
+        float lap = up[hx] + down[hx] + mid[hx - 1] + mid[hx + 1] - 4.0f * mid[hx];
+        out[hx] = (mid[hx] + HEAT_DIFFUSION * lap) * HEAT_RETENTION;
     }
 }
 
+static void heat_diffuse_rows(Simulation *sim, int y0, int y1) {
+    int stride = sim->heat_stride;
+
+    for (int hy = y0; hy < y1; hy++) {
+        const float *mid = sim->heat + (hy + 1) * stride + 1;
+        float *out = sim->heat_back + (hy + 1) * stride + 1;
+
+        heat_diffuse_row(out, mid - stride, mid, mid + stride, sim->heat_width);
+    }
+}
+
+static void heat_diffuse(Simulation *sim) {
+    heat_fill_border(sim);
+
+    int bands = (sim->heat_height + HEAT_BAND_ROWS - 1) / HEAT_BAND_ROWS;
+
+#ifdef _OPENMP
+    bool parallel = bands > 1 && sim->heat_width * sim->heat_height >= HEAT_PARALLEL_CELLS;
+    #pragma omp parallel for schedule(static) if (parallel)
+#endif
+    for (int band = 0; band < bands; band++) {
+        int y0 = band * HEAT_BAND_ROWS;
+        int y1 = y0 + HEAT_BAND_ROWS;
+        if (y1 > sim->heat_height)
+            y1 = sim->heat_height;
+
+        heat_diffuse_rows(sim, y0, y1);
+    }
+
+    float *temp = sim->heat;
+    sim->heat = sim->heat_back;
+    sim->heat_back = temp;
+}
+
 void sim_update(Simulation *sim) {
     // for (int y = SIM_HEIGHT - 1; y >= 0; y--) {
     //     if (y % 2 == 0) {
@@ -339,29 +758,72 @@ void sim_update(Simulation *sim) {
     //     }
     // }
 
+    sim_begin_tick(sim);
+    sim_update_rows(sim, 0, sim->height);
+}
+
+void sim_begin_tick(Simulation *sim) {
+    sim_apply_commands(sim);
+
     sim->current_tick++;
 
-    for (int i = 0; i < SIM_WIDTH * SIM_HEIGHT; i++) {
-        if (sim->grid[i]) {
-            sim->grid[i]->updated = false;
+    heat_diffuse(sim);
+
+    for (int y = 0; y < sim->height; y++) {
+        if (sim->row_active[y] == 0)
+            continue;
+
+        for (int x = next_active(sim, 0, y); x < sim->width; x = next_active(sim, x + 1, y)) {
+            sim->grid[get_grid_idx(sim, x, y)]->updated = false;
         }
     }
+}
 
-    bool left_to_right = (sim->current_tick % 2) == 0;
+// the bitset is re-read after every update, so a particle that moved
+// sideways ahead of the sweep is seen exactly as a full scan would see it
+static void update_row(Simulation *sim, int y, bool left_to_right) {
+    if (sim->row_active[y] == 0)
+        return;
 
-    for (int y = SIM_HEIGHT - 1; y >= 0; y--) {
-        if (left_to_right) {
-            for (int x = 0; x < SIM_WIDTH; x++) {
-                update_particle(sim, x, y);
-            }
-        } else {
-            for (int x = SIM_WIDTH - 1; x >= 0; x--) {
-                update_particle(sim, x, y);
-            }
+    if (left_to_right) {
+        for (int x = next_active(sim, 0, y); x < sim->width; x = next_active(sim, x + 1, y)) {
+            update_particle(sim, x, y);
+        }
+    } else {
+        for (int x = prev_active(sim, sim->width - 1, y); x >= 0; x = prev_active(sim, x - 1, y)) {
+            update_particle(sim, x, y);
         }
     }
 }
 
+void sim_update_rows(Simulation *sim, int y_begin, int y_end) {
+    bool left_to_right = (sim->current_tick % 2) == 0;
+
+    for (int y = y_end - 1; y >= y_begin; y--) {
+        update_row(sim, y, left_to_right);
+    }
+}
+
+void sim_update_fused(Simulation *sim, SimRowCallback row_done, void *user) {
+    sim_begin_tick(sim);
+
+    bool left_to_right = (sim->current_tick % 2) == 0;
+
+    // once row y is swept nothing later in the tick can reach
+    // row y + SIM_ROW_REACH or anything below it
+    for (int y = sim->height - 1; y >= 0; y--) {
+        update_row(sim, y, left_to_right);
+
+        if (y + SIM_ROW_REACH < sim->height)
+            row_done(sim, y + SIM_ROW_REACH, user);
+    }
+
+    int tail = (sim->height < SIM_ROW_REACH) ? sim->height : SIM_ROW_REACH;
+    for (int y = tail - 1; y >= 0; y--) {
+        row_done(sim, y, user);
+    }
+}
+
 void sim_brush_cirlce(Simulation *sim, int cx, int cy, int radius, ParticleType type) {
     int r2 = radius * radius;
 
@@ -393,3 +855,87 @@ void sim_brush_erase(Simulation *sim, int cx, int cy, int radius) {
         }
     }
 }
+
+void sim_brush_heat(Simulation *sim, int cx, int cy, int radius, float amount) {
+    int hcx = cx >> HEAT_CELL_SHIFT;
+    int hcy = cy >> HEAT_CELL_SHIFT;
+    int hr = (radius + HEAT_CELL_SIZE - 1) >> HEAT_CELL_SHIFT;
+    int r2 = hr * hr;
+
+    for (int dy = -hr; dy <= hr; dy++) {
+        for (int dx = -hr; dx <= hr; dx++) {
+            if (dx * dx + dy * dy > r2)
+                continue;
+
+            int hx = hcx + dx;
+            int hy = hcy + dy;
+
+            if (hx < 0 || hx >= sim->heat_width || hy < 0 || hy >= sim->heat_height)
+                continue;
+
+            float *cell = heat_cell(sim, hx, hy);
+            *cell += amount;
+            if (*cell > HEAT_MAX) *cell = HEAT_MAX;
+            if (*cell < -HEAT_MAX) *cell = -HEAT_MAX;
+        }
+    }
+}
+
+void sim_brush_line(Simulation *sim, int x0, int y0, int x1, int y1, int radius, ParticleType type) {
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+    int length = (dx > dy) ? dx : dy;
+
+    // stamps overlap by half a radius so fast strokes leave no gaps
+    int step = (radius / 2 > 0) ? radius / 2 : 1;
+
+    for (int i = 0;; i += step) {
+        if (i > length)
+            i = length;
+
+        int x = x0 + (length ? (x1 - x0) * i / length : 0);
+        int y = y0 + (length ? (y1 - y0) * i / length : 0);
+
+        if (type == PARTICLE_NONE)
+            sim_brush_erase(sim, x, y, radius);
+        else
+            sim_brush_cirlce(sim, x, y, radius, type);
+
+        if (i == length)
+            break;
+    }
+}
+
+void sim_apply_command(Simulation *sim, const Command *command) {
+    switch (command->kind) {
+        case COMMAND_PAINT:
+            sim_brush_cirlce(sim, command->x, command->y, command->radius, command->type);
+            break;
+        case COMMAND_ERASE:
+            sim_brush_erase(sim, command->x, command->y, command->radius);
+            break;
+        case COMMAND_HEAT:
+            sim_brush_heat(sim, command->x, command->y, command->radius, command->amount);
+            break;
+        case COMMAND_LINE:
+            sim_brush_line(sim, command->x, command->y, command->x2, command->y2,
+                           command->radius, command->type);
+            break;
+        case COMMAND_CLEAR:
+            sim_clear(sim);
+            break;
+        case COMMAND_RESET:
+            sim_reset(sim);
+            break;
+    }
+}
+
+// at most one ring's worth, so a producer that keeps pushing from another
+// thread cannot hold up the tick
+void sim_apply_commands(Simulation *sim) {
+    Command command;
+
+    for (int i = 0; i < COMMAND_QUEUE_CAPACITY && command_queue_pop(&sim->commands, &command); i++) {
+        sim_apply_command(sim, &command);
+    }
+}
@@ -0,0 +1,102 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "simulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// tick and texture conversion cost on wide worlds for whichever grid
+// layout this was built with; build once plain and once with TILED=1,
+// cleaning in between since objects do not track the flag
+
+#define WARMUP_TICKS 5
+#define TICKS 20
+#define CONVERSIONS 10
+
+typedef struct {
+    int width;
+    int height;
+    double fill;
+} World;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// the same run-at-a-time walk the game texture upload does
+static void convert(Simulation *sim, uint32_t *pixels) {
+    for (int y = 0; y < sim->height; y++) {
+        uint32_t *row = pixels + (size_t)y * sim->width;
+
+        for (int x0 = 0; x0 < sim->width; ) {
+            int run = sim_grid_run(sim, x0);
+            Particle **cells = sim->grid + sim_grid_index(sim, x0, y);
+
+            for (int i = 0; i < run; i++) {
+                row[x0 + i] = cells[i] ? color_pack(cells[i]->color) : 0x00000000;
+            }
+            x0 += run;
+        }
+    }
+}
+
+int main(void) {
+    const World worlds[] = {
+        { 4096, 1024, 0.10 },
+        { 4096, 1024, 0.50 },
+        { 4096, 4096, 0.10 },
+        { 4096, 4096, 0.50 }
+    };
+
+#ifdef SIM_TILED
+    printf("layout: %dx%d tiles\n", SIM_TILE_WIDTH, SIM_TILE_HEIGHT);
+#else
+    printf("layout: row-major\n");
+#endif
+
+    for (size_t k = 0; k < sizeof(worlds) / sizeof(worlds[0]); k++) {
+        const World *world = &worlds[k];
+        Simulation sim = { 0 };
+        uint32_t *pixels = (uint32_t *)malloc((size_t)world->width * world->height * sizeof(uint32_t));
+
+        if (!pixels || !sim_init(&sim, world->width, world->height)) {
+            fprintf(stderr, "bench_layout: setup failed\n");
+            return 1;
+        }
+        sim.rng_state = 12345;
+
+        srand(7);
+        for (int y = 0; y < world->height; y++) {
+            for (int x = 0; x < world->width; x++) {
+                if (rand() < world->fill * RAND_MAX)
+                    sim_spawn_particles(&sim, x, y, (rand() & 1) ? PARTICLE_SAND : PARTICLE_WATER);
+            }
+        }
+
+        for (int t = 0; t < WARMUP_TICKS; t++) {
+            sim_update(&sim);
+        }
+
+        double start = now_ms();
+        for (int t = 0; t < TICKS; t++) {
+            sim_update(&sim);
+        }
+        double tick_ms = (now_ms() - start) / TICKS;
+
+        start = now_ms();
+        for (int i = 0; i < CONVERSIONS; i++) {
+            convert(&sim, pixels);
+        }
+        double texture_ms = (now_ms() - start) / CONVERSIONS;
+
+        printf("%dx%d %3.0f%%  tick %8.3f ms  texture %7.3f ms\n",
+               world->width, world->height, world->fill * 100.0, tick_ms, texture_ms);
+
+        sim_cleanup(&sim);
+        free(pixels);
+    }
+
+    return 0;
+}
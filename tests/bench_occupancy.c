@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "simulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// tick cost for sparse, medium and dense worlds; with the sweep visiting
+// only occupied cells it should track the particle count, not the area
+
+#define WIDTH 1024
+#define HEIGHT 1024
+#define WARMUP_TICKS 20
+#define TICKS 200
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int count_particles(Simulation *sim) {
+    int count = 0;
+
+    for (int y = 0; y < sim->height; y++) {
+        for (int x = 0; x < sim->width; x++) {
+            count += sim->grid[sim_grid_index(sim, x, y)] != NULL;
+        }
+    }
+
+    return count;
+}
+
+int main(void) {
+    const double occupancy[] = { 0.01, 0.10, 0.90 };
+
+    for (size_t k = 0; k < sizeof(occupancy) / sizeof(occupancy[0]); k++) {
+        Simulation sim = { 0 };
+        if (!sim_init(&sim, WIDTH, HEIGHT)) {
+            fprintf(stderr, "bench_occupancy: sim_init failed\n");
+            return 1;
+        }
+        sim.rng_state = 12345;
+
+        srand(7);
+        for (int y = 0; y < HEIGHT; y++) {
+            for (int x = 0; x < WIDTH; x++) {
+                if (rand() < occupancy[k] * RAND_MAX)
+                    sim_spawn_particles(&sim, x, y, (rand() & 1) ? PARTICLE_SAND : PARTICLE_WATER);
+            }
+        }
+
+        int particles = count_particles(&sim);
+
+        for (int t = 0; t < WARMUP_TICKS; t++) {
+            sim_update(&sim);
+        }
+
+        double start = now_ms();
+        for (int t = 0; t < TICKS; t++) {
+            sim_update(&sim);
+        }
+        double tick_ms = (now_ms() - start) / TICKS;
+
+        printf("occupancy %3.0f%%  %7d particles  %8.3f ms/tick  %6.1f ns/particle\n",
+               occupancy[k] * 100.0, particles, tick_ms, tick_ms * 1e6 / particles);
+
+        if (count_particles(&sim) != particles) {
+            fprintf(stderr, "bench_occupancy: particle count changed\n");
+            sim_cleanup(&sim);
+            return 1;
+        }
+
+        sim_cleanup(&sim);
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include "simulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// startup and reset cost: init alone, the first frame (init, one tick and
+// a full texture conversion), and emptying a 30% full, heated world either
+// with sim_reset or by tearing it down and building it again
+
+#define RUNS 3
+#define FILL 0.30
+
+typedef struct {
+    double init;
+    double first_frame;
+    double reset;
+    double rebuild;
+} Timings;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void convert(Simulation *sim, uint32_t *pixels) {
+    for (int y = 0; y < sim->height; y++) {
+        for (int x = 0; x < sim->width; x++) {
+            Particle *p = sim->grid[sim_grid_index(sim, x, y)];
+            pixels[y * sim->width + x] = p ? color_pack(p->color) : 0x00000000;
+        }
+    }
+}
+
+static void fill(Simulation *sim) {
+    srand(11);
+    for (int y = 0; y < sim->height; y++) {
+        for (int x = 0; x < sim->width; x++) {
+            if (rand() < FILL * RAND_MAX)
+                sim_spawn_particles(sim, x, y, PARTICLE_SAND);
+        }
+    }
+
+    sim_brush_heat(sim, sim->width / 2, sim->height / 2, sim->width / 4, 300.0f);
+}
+
+static bool run(int width, int height, uint32_t *pixels, Timings *out) {
+    Simulation sim = { 0 };
+
+    double start = now_ms();
+    if (!sim_init(&sim, width, height))
+        return false;
+    out->init = now_ms() - start;
+    sim_cleanup(&sim);
+
+    start = now_ms();
+    if (!sim_init(&sim, width, height))
+        return false;
+    sim_update(&sim);
+    convert(&sim, pixels);
+    out->first_frame = now_ms() - start;
+
+    fill(&sim);
+    start = now_ms();
+    sim_reset(&sim);
+    out->reset = now_ms() - start;
+
+    fill(&sim);
+    start = now_ms();
+    sim_cleanup(&sim);
+    if (!sim_init(&sim, width, height))
+        return false;
+    out->rebuild = now_ms() - start;
+
+    sim_cleanup(&sim);
+    return true;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *values) {
+    qsort(values, RUNS, sizeof(double), compare_doubles);
+    return values[RUNS / 2];
+}
+
+int main(void) {
+    const int sizes[][2] = { { 1024, 1024 }, { 4096, 4096 } };
+
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        int width = sizes[k][0];
+        int height = sizes[k][1];
+        uint32_t *pixels = (uint32_t *)malloc((size_t)width * height * sizeof(uint32_t));
+        double init[RUNS], first_frame[RUNS], reset[RUNS], rebuild[RUNS];
+
+        if (!pixels) {
+            fprintf(stderr, "bench_reset: out of memory\n");
+            return 1;
+        }
+
+        for (int r = 0; r < RUNS; r++) {
+            Timings t;
+            if (!run(width, height, pixels, &t)) {
+                fprintf(stderr, "bench_reset: sim_init failed\n");
+                return 1;
+            }
+            init[r] = t.init;
+            first_frame[r] = t.first_frame;
+            reset[r] = t.reset;
+            rebuild[r] = t.rebuild;
+        }
+
+        printf("%4dx%-4d  init %7.3f ms  first frame %8.3f ms  reset %7.3f ms  rebuild %7.3f ms\n",
+               width, height, median(init), median(first_frame), median(reset), median(rebuild));
+
+        free(pixels);
+    }
+
+    return 0;
+}
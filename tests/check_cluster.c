@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cluster.h"
+#include "simulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// worlds that straddle slab seams should behave like they do in a single
+// process; the two are not step-equivalent, so only coarse measures of
+// each world are compared, plus exact particle counts
+
+#define MAX_EDITS 512
+
+typedef struct {
+    Command commands[MAX_EDITS];
+    int count;
+} Edits;
+
+typedef struct {
+    int width;
+    int height;
+    int procs;
+    int ticks;
+    // edits before the first tick, and before each tick while heat_ticks last
+    void (*build)(Edits *edits);
+    void (*heat)(Edits *edits);
+    int heat_ticks;
+} Scenario;
+
+typedef struct {
+    int count;
+    int types[PARTICLE_COUNT];
+    int top;
+    int bottom;
+    int empty_rows;
+    int water_left;
+    int water_right;
+} Measure;
+
+static void add(Edits *edits, Command command) {
+    if (edits->count < MAX_EDITS)
+        edits->commands[edits->count++] = command;
+}
+
+static void add_rect(Edits *edits, int x0, int y0, int x1, int y1, ParticleType type) {
+    for (int y = y0; y <= y1; y++) {
+        add(edits, (Command){
+            .kind = COMMAND_LINE, .x = x0, .y = y, .x2 = x1, .y2 = y, .radius = 0, .type = type
+        });
+    }
+}
+
+static ParticleType pixel_type(uint32_t pixel) {
+    for (int type = PARTICLE_NONE + 1; type < PARTICLE_COUNT; type++) {
+        if (pixel == color_pack(particle_create((ParticleType)type).color))
+            return (ParticleType)type;
+    }
+    return PARTICLE_NONE;
+}
+
+static Measure measure(const Scenario *scenario, const uint32_t *pixels) {
+    Measure m = { 0 };
+    m.top = scenario->height;
+    m.bottom = -1;
+    m.water_left = scenario->width;
+    m.water_right = -1;
+
+    for (int y = 0; y < scenario->height; y++) {
+        int row = 0;
+
+        for (int x = 0; x < scenario->width; x++) {
+            ParticleType type = pixel_type(pixels[y * scenario->width + x]);
+            if (type == PARTICLE_NONE)
+                continue;
+
+            row++;
+            m.types[type]++;
+            if (type == PARTICLE_WATER) {
+                if (x < m.water_left) m.water_left = x;
+                if (x > m.water_right) m.water_right = x;
+            }
+        }
+
+        m.count += row;
+        if (row > 0) {
+            if (y < m.top) m.top = y;
+            m.bottom = y;
+        }
+    }
+
+    for (int y = m.top; y <= m.bottom; y++) {
+        int row = 0;
+        for (int x = 0; x < scenario->width; x++) {
+            row += pixels[y * scenario->width + x] != 0;
+        }
+        m.empty_rows += row == 0;
+    }
+
+    return m;
+}
+
+static bool run_single(const Scenario *scenario, uint32_t *pixels) {
+    Simulation sim = { 0 };
+    Edits edits = { 0 };
+
+    if (!sim_init(&sim, scenario->width, scenario->height))
+        return false;
+    sim.rng_state = 1;
+
+    scenario->build(&edits);
+    for (int i = 0; i < edits.count; i++) {
+        sim_apply_command(&sim, &edits.commands[i]);
+    }
+
+    for (int t = 0; t < scenario->ticks; t++) {
+        if (t < scenario->heat_ticks) {
+            edits.count = 0;
+            scenario->heat(&edits);
+            for (int i = 0; i < edits.count; i++) {
+                sim_apply_command(&sim, &edits.commands[i]);
+            }
+        }
+        sim_update(&sim);
+    }
+
+    for (int y = 0; y < scenario->height; y++) {
+        for (int x = 0; x < scenario->width; x++) {
+            Particle *p = sim.grid[sim_grid_index(&sim, x, y)];
+            pixels[y * scenario->width + x] = p ? color_pack(p->color) : 0x00000000;
+        }
+    }
+
+    sim_cleanup(&sim);
+    return true;
+}
+
+static bool run_cluster(const Scenario *scenario, uint32_t *pixels) {
+    Cluster cluster;
+    Edits edits = { 0 };
+
+    if (!cluster_start(&cluster, scenario->procs, scenario->width, scenario->height, 1))
+        return false;
+
+    bool ok = true;
+    scenario->build(&edits);
+    for (int i = 0; i < edits.count && ok; i++) {
+        ok = cluster_edit(&cluster, &edits.commands[i]);
+    }
+
+    for (int t = 0; t < scenario->heat_ticks && ok; t++) {
+        edits.count = 0;
+        scenario->heat(&edits);
+        for (int i = 0; i < edits.count && ok; i++) {
+            ok = cluster_edit(&cluster, &edits.commands[i]);
+        }
+        ok = ok && cluster_step(&cluster, 1);
+    }
+
+    if (scenario->ticks > scenario->heat_ticks)
+        ok = ok && cluster_step(&cluster, scenario->ticks - scenario->heat_ticks);
+    ok = ok && cluster_read_frame(&cluster, pixels, scenario->width);
+
+    cluster_stop(&cluster);
+    return ok;
+}
+
+static bool compare(const char *name, const Scenario *scenario, Measure *single, Measure *split) {
+    uint32_t *a = (uint32_t *)calloc((size_t)scenario->width * scenario->height, sizeof(uint32_t));
+    uint32_t *b = (uint32_t *)calloc((size_t)scenario->width * scenario->height, sizeof(uint32_t));
+
+    bool ok = a && b && run_single(scenario, a) && run_cluster(scenario, b);
+    if (ok) {
+        *single = measure(scenario, a);
+        *split = measure(scenario, b);
+    } else {
+        fprintf(stderr, "check_cluster: %s: setup failed\n", name);
+    }
+
+    free(a);
+    free(b);
+    return ok;
+}
+
+static bool report(const char *name, bool ok, const char *what) {
+    if (!ok)
+        fprintf(stderr, "check_cluster: %s: %s\n", name, what);
+    return ok;
+}
+
+// a free-falling block crossing every seam of two workers
+
+static void build_block(Edits *edits) {
+    add_rect(edits, 20, 10, 44, 69, PARTICLE_SAND);
+}
+
+static bool check_block(void) {
+    const Scenario scenario = { 64, 256, 2, 24, build_block, NULL, 0 };
+    Measure a, b;
+
+    if (!compare("falling block", &scenario, &a, &b))
+        return false;
+
+    printf("falling block: rows %d..%d, %d empty; cluster rows %d..%d, %d empty\n",
+           a.top, a.bottom, a.empty_rows, b.top, b.bottom, b.empty_rows);
+
+    int span_diff = abs((b.bottom - b.top) - (a.bottom - a.top));
+    return report("falling block", a.count == 25 * 60 && b.count == a.count, "particles lost") &&
+           report("falling block", b.empty_rows <= a.empty_rows + 2 && span_diff <= 8,
+                  "block torn apart at the seams");
+}
+
+// water poured on a settled bed of sand whose support runs through the
+// seam between the two workers and both their midlines
+
+static void build_pool(Edits *edits) {
+    add_rect(edits, 0, 48, 63, 127, PARTICLE_SAND);
+    add_rect(edits, 30, 10, 33, 47, PARTICLE_WATER);
+}
+
+static bool check_pool(void) {
+    const Scenario scenario = { 64, 128, 2, 300, build_pool, NULL, 0 };
+    Measure a, b;
+
+    if (!compare("resting water", &scenario, &a, &b))
+        return false;
+
+    printf("resting water: spreads over x %d..%d; cluster x %d..%d\n",
+           a.water_left, a.water_right, b.water_left, b.water_right);
+
+    int width_a = a.water_right - a.water_left + 1;
+    int width_b = b.water_right - b.water_left + 1;
+    return report("resting water", b.count == a.count, "particles lost") &&
+           report("resting water", width_b * 4 >= width_a * 3, "water stopped spreading");
+}
+
+// a resting pile heated just above the seam until it turns to glass
+
+static void build_pile(Edits *edits) {
+    add_rect(edits, 0, 40, 63, 127, PARTICLE_SAND);
+}
+
+static void heat_pile(Edits *edits) {
+    add(edits, (Command){ .kind = COMMAND_HEAT, .x = 32, .y = 50, .radius = 8, .amount = 60.0f });
+}
+
+static bool check_pile(void) {
+    const Scenario scenario = { 64, 128, 2, 200, build_pile, heat_pile, 150 };
+    Measure a, b;
+
+    if (!compare("heated pile", &scenario, &a, &b))
+        return false;
+
+    int glass_a = a.types[PARTICLE_GLASS];
+    int glass_b = b.types[PARTICLE_GLASS];
+    printf("heated pile: %d glass; cluster %d glass\n", glass_a, glass_b);
+
+    return report("heated pile", glass_a > 0 && b.count == a.count, "particles lost") &&
+           report("heated pile", glass_b * 4 >= glass_a * 3 && glass_b * 3 <= glass_a * 4,
+                  "heat transitions diverged");
+}
+
+// smoke and steam churning in a heated glass box across the seams of four
+// workers, where gas keeps crossing every slab boundary
+
+static void build_box(Edits *edits) {
+    add_rect(edits, 8, 24, 55, 25, PARTICLE_GLASS);
+    add_rect(edits, 8, 230, 55, 231, PARTICLE_GLASS);
+    add_rect(edits, 8, 26, 9, 229, PARTICLE_GLASS);
+    add_rect(edits, 54, 26, 55, 229, PARTICLE_GLASS);
+
+    for (int y = 40; y < 220; y += 6) {
+        add_rect(edits, 12, y, 51, y + 2, (y / 6) % 2 ? PARTICLE_SMOKE : PARTICLE_STEAM);
+    }
+}
+
+static void heat_box(Edits *edits) {
+    add(edits, (Command){ .kind = COMMAND_HEAT, .x = 32, .y = 220, .radius = 16, .amount = 40.0f });
+    add(edits, (Command){ .kind = COMMAND_HEAT, .x = 32, .y = 128, .radius = 16, .amount = 40.0f });
+}
+
+static bool check_box(void) {
+    const Scenario scenario = { 64, 256, 4, 300, build_box, heat_box, 300 };
+    Measure a, b;
+
+    if (!compare("gas box", &scenario, &a, &b))
+        return false;
+
+    printf("gas box: %d particles; cluster %d\n", a.count, b.count);
+
+    return report("gas box", b.count == a.count, "particles lost");
+}
+
+int main(void) {
+    bool ok = check_block();
+    ok = check_pool() && ok;
+    ok = check_pile() && ok;
+    ok = check_box() && ok;
+
+    return ok ? 0 : 1;
+}
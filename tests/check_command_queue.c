@@ -0,0 +1,87 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "command.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+// one thread pushes while another pops; every command must come out once,
+// in order and with every field intact, across many trips round the ring
+
+#define COMMANDS 200000
+
+static CommandQueue queue;
+
+static Command make_command(int i) {
+    return (Command){
+        .kind = (CommandKind)(i % (COMMAND_RESET + 1)),
+        .x = i,
+        .y = ~i,
+        .x2 = i * 3,
+        .y2 = -i,
+        .radius = i & 0xff,
+        .type = (ParticleType)(i % PARTICLE_COUNT),
+        .amount = (float)(i & 0xffff)
+    };
+}
+
+static bool same_command(const Command *a, const Command *b) {
+    return a->kind == b->kind && a->x == b->x && a->y == b->y &&
+           a->x2 == b->x2 && a->y2 == b->y2 && a->radius == b->radius &&
+           a->type == b->type && a->amount == b->amount;
+}
+
+static void *producer(void *arg) {
+    (void)arg;
+
+    for (int i = 0; i < COMMANDS; ) {
+        Command command = make_command(i);
+
+        // a full ring means the consumer has to run first
+        if (command_queue_push(&queue, &command))
+            i++;
+        else
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+int main(void) {
+    pthread_t thread;
+
+    command_queue_init(&queue);
+    if (pthread_create(&thread, NULL, producer, NULL) != 0) {
+        fprintf(stderr, "check_command_queue: pthread_create failed\n");
+        return 1;
+    }
+
+    int bad = 0;
+    for (int i = 0; i < COMMANDS; ) {
+        Command command;
+
+        if (!command_queue_pop(&queue, &command)) {
+            sched_yield();
+            continue;
+        }
+
+        Command expected = make_command(i);
+        if (!same_command(&command, &expected)) {
+            if (bad == 0)
+                fprintf(stderr, "check_command_queue: command %d arrived as %d\n", i, command.x);
+            bad++;
+        }
+        i++;
+    }
+
+    pthread_join(thread, NULL);
+
+    Command extra;
+    if (command_queue_pop(&queue, &extra)) {
+        fprintf(stderr, "check_command_queue: ring not empty after the last command\n");
+        return 1;
+    }
+
+    printf("command queue: %d commands, %d out of order or torn\n", COMMANDS, bad);
+    return bad != 0;
+}
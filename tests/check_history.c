@@ -0,0 +1,140 @@
+#include "history.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// seeking to any recorded tick must rebuild the grid exactly as it was
+// when that tick was recorded, with velocities at the precision history
+// keeps them
+
+#define WIDTH 200
+#define HEIGHT 150
+#define TICKS 900
+#define POUR_TICKS 500
+
+static uint64_t fnv(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static float quantise(float v) {
+    // + 0.0f folds -0 into 0
+    return roundf(v * HISTORY_VELOCITY_SCALE) + 0.0f;
+}
+
+static uint64_t grid_hash(Simulation *sim) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            Particle *p = sim->grid[sim_grid_index(sim, x, y)];
+            int type = p ? (int)p->type : 0;
+
+            hash = fnv(hash, &type, sizeof(type));
+            if (!p)
+                continue;
+
+            float v[2] = { quantise(p->vx), quantise(p->vy) };
+            hash = fnv(hash, &p->color, sizeof(p->color));
+            hash = fnv(hash, v, sizeof(v));
+        }
+    }
+
+    return hash;
+}
+
+static bool run(size_t budget) {
+    // deliberately dirty memory, so sim_init has to set every field itself
+    Simulation *sim = (Simulation *)malloc(sizeof(Simulation));
+    uint64_t *hashes = (uint64_t *)calloc(TICKS + 1, sizeof(uint64_t));
+    History history;
+
+    if (!sim || !hashes)
+        return false;
+    memset(sim, 0xab, sizeof(*sim));
+
+    if (!sim_init(sim, WIDTH, HEIGHT) || !history_init(&history, sim, budget))
+        return false;
+    sim->rng_state = 99;
+
+    bool ok = history_record(&history, sim);
+    hashes[0] = grid_hash(sim);
+
+    for (int t = 1; t <= TICKS && ok; t++) {
+        if (t < POUR_TICKS)
+            sim_brush_cirlce(sim, 20 + (t * 7) % 160, 10, 4, (t % 3) ? PARTICLE_SAND : PARTICLE_WATER);
+
+        sim_update(sim);
+        ok = history_record(&history, sim);
+        hashes[sim->current_tick] = grid_hash(sim);
+    }
+
+    int first = history_first_tick(&history);
+    int last = history_last_tick(&history);
+    int targets[] = {
+        last - 1, last - 30, first, first + (last - first) / 2 + 7,
+        last, first + (last - first) / 3, last - (last - first) * 3 / 4, last
+    };
+
+    for (size_t k = 0; k < sizeof(targets) / sizeof(targets[0]) && ok; k++) {
+        int tick = targets[k];
+
+        if (!history_seek(&history, sim, tick) || grid_hash(sim) != hashes[tick]) {
+            fprintf(stderr, "check_history: seek to tick %d differs (%zu MB)\n", tick, budget >> 20);
+            ok = false;
+        }
+    }
+
+    // recording after scrubbing back replaces the ticks after the cursor
+    int resume = last - 100;
+    if (ok && history_seek(&history, sim, resume)) {
+        for (int i = 0; i < 50 && ok; i++) {
+            sim_update(sim);
+            ok = history_record(&history, sim);
+        }
+        if (history_last_tick(&history) != resume + 50) {
+            fprintf(stderr, "check_history: resumed timeline ends at %d\n", history_last_tick(&history));
+            ok = false;
+        }
+    }
+
+    printf("history: %zu MB keeps ticks %d..%d\n", budget >> 20, first, last);
+
+    history_cleanup(&history);
+    sim_cleanup(sim);
+    free(sim);
+    free(hashes);
+    return ok;
+}
+
+// the budget covers the working arrays too, so one too small for them
+// and a single keyframe has to be refused
+static bool refuses_tiny_budget(void) {
+    Simulation sim = { 0 };
+    History history;
+
+    if (!sim_init(&sim, WIDTH, HEIGHT))
+        return false;
+
+    bool refused = !history_init(&history, &sim, (size_t)2 << 20);
+    if (!refused) {
+        fprintf(stderr, "check_history: 2 MB budget accepted\n");
+        history_cleanup(&history);
+    }
+
+    sim_cleanup(&sim);
+    return refused;
+}
+
+int main(void) {
+    // the small budget evicts keyframes, the large one keeps everything
+    if (!refuses_tiny_budget() || !run((size_t)8 << 20) || !run((size_t)64 << 20))
+        return 1;
+
+    return 0;
+}